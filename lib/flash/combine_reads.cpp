@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #if defined(__GNUC__) && defined(__SSE2__)
 #  define WITH_SSE2
@@ -41,6 +42,21 @@
 #  include <emmintrin.h>
 #endif
 
+/* Wider kernels are compiled with target attributes and selected at runtime,
+ * independent of the flags the rest of the file is compiled with.  */
+#if defined(__GNUC__) && defined(__x86_64__)
+#  if defined(__clang__) || __GNUC__ >= 5
+#    define WITH_AVX2_DISPATCH
+#    define WITH_AVX512_DISPATCH
+#  elif __GNUC__ == 4 && __GNUC_MINOR__ >= 9
+#    define WITH_AVX2_DISPATCH
+#  endif
+#endif
+
+#if defined(WITH_AVX2_DISPATCH) || defined(WITH_AVX512_DISPATCH)
+#  include <immintrin.h>
+#endif
+
 #ifdef WITH_SSE2
 
 
@@ -87,180 +103,524 @@ hsum32_v16(__m128i v)
 
 #endif /* WITH_SSE2 */
 
+/* Scalar reference for compute_mismatch_stats(), also used for the
+ * remainders of the vectorized implementations.  */
+static inline void
+mismatch_stats_scalar(const char * seq_1,
+                      const char * seq_2,
+                      const char * qual_1,
+                      const char * qual_2,
+                      bool haveN,
+                      int len,
+                      unsigned * num_mismatches_p,
+                      unsigned * mismatch_qual_total_p,
+                      int * num_uncalled_p)
+{
+    for (int i = 0; i < len; i++) {
+        if (haveN && (seq_1[i] == 'N' || seq_2[i] == 'N')) {
+            (*num_uncalled_p)++;
+        } else if (seq_1[i] != seq_2[i])  {
+            (*num_mismatches_p)++;
+            *mismatch_qual_total_p += min(qual_1[i], qual_2[i]);
+        }
+    }
+}
+
 /*
- * Compute mismatch statistics between two sequences.
+ * Baseline implementation, vectorized with SSE2 if available.
  *
- * @seq_1, @seq_2:
- *	The two sequences to compare (ASCII characters A, C, G, T, N).
- * @qual_1, @qual_2:
- *	Quality scores for the two sequences, based at 0.
- * @haveN
- *	As an optimization, this can be set to %false to indicate that neither
- *	sequence contains an uncalled base (represented as an N character).
- * @len_p
- *	Pointer to the length of the sequence.  This value will be updated to
- *	subtract the number of positions at which an uncalled base (N) exists in
- *	either sequence.
- * @num_mismatches_ret
- *	Location into which to return the number of positions at which the bases
- *	were mismatched.
- * @mismatch_qual_total_ret
- *	Location into which to return the sum of lesser quality scores at
- *	mismatch sites.
+ * Positions with an N in either sequence are masked out of the mismatch
+ * comparison and tallied separately, so reads with uncalled bases do not fall
+ * back to the scalar loop.
  */
-static inline void
-compute_mismatch_stats(const char * seq_1,
+static void
+mismatch_stats_default(const char * seq_1,
                        const char * seq_2,
                        const char * qual_1,
                        const char * qual_2,
                        bool haveN,
-                       int * len_p,
+                       int len,
                        unsigned * num_mismatches_ret,
-                       unsigned * mismatch_qual_total_ret)
+                       unsigned * mismatch_qual_total_ret,
+                       int * num_uncalled_ret)
 {
     int num_uncalled = 0;
     unsigned num_mismatches = 0;
     unsigned mismatch_qual_total = 0;
-    int len = *len_p;
 
-    if (haveN) {
-        for (int i = 0; i < len; i++) {
-            if (seq_1[i] == 'N' || seq_2[i] == 'N') {
-                num_uncalled++;
-            } else {
-                if (seq_1[i] != seq_2[i])  {
-                    num_mismatches++;
-                    mismatch_qual_total += min(qual_1[i], qual_2[i]);
-                }
-            }
-        }
-    } else {
-        /* This part of the 'if' statement is for optimization purposes
-         * only; its behavior is equivalent to the block above, except
-         * this block assumes there are no N characters in the input,
-         * and therefore no further checks for N's are needed.
+#ifdef WITH_SSE2
+
+    /* Optional vectorized implementation (about twice as fast as
+     * nonvectorized on x86_64).  */
+
+    while (len >= 16) {
+
+        /* 16 x 8 bit counters for number of mismatches and uncalled bases  */
+        __m128i num_mismatches_v8 = _mm_set1_epi8(0);
+        __m128i num_uncalled_v8 = _mm_set1_epi8(0);
+
+        /* 8 x 16 bit counters for mismatch quality total  */
+        __m128i mismatch_qual_total_v16 = _mm_set1_epi16(0);
+
+        /* The counters of num_mismatches_v8 will overflow if
+         * 256 mismatches are detected at the same position
+         * modulo 16 bytes.  So, don't process 4096 or more
+         * bytes before reducing the counters.
          *
-         * Note: this optimization is only useful if most reads don't
-         * contain N characters.  */
+         * mismatch_qual_total_v16 would overflow even faster,
+         * but we use 16-bit counters for it.  */
+
+        int todo = min(len, 255 * 16) & ~0xf;
+        len -= todo;
+
+        do {
+
+            /* Load 16 bases  */
+            __m128i s1_v8 = _mm_loadu_si128((const __m128i *)seq_1);
+            __m128i s2_v8 = _mm_loadu_si128((const __m128i *)seq_2);
+
+            /* Load 16 quality scores  */
+            __m128i q1_v8 = _mm_loadu_si128((const __m128i *)qual_1);
+            __m128i q2_v8 = _mm_loadu_si128((const __m128i *)qual_2);
+
+            /* Compare bases with each other and negate the
+             * result.  This will produce 0xff in bytes
+             * where the bases differ and 0x00 in bytes
+             * where the bases were the same.  */
+            __m128i cmpresult = ~_mm_cmpeq_epi8(s1_v8, s2_v8);
+
+            if (haveN) {
+                /* 0xff where either base is uncalled, these
+                 * are no mismatches.  */
+                __m128i n_v8 = _mm_set1_epi8('N');
+                __m128i uncalled = _mm_cmpeq_epi8(s1_v8, n_v8) |
+                                   _mm_cmpeq_epi8(s2_v8, n_v8);
+                num_uncalled_v8 = _mm_sub_epi8(num_uncalled_v8,
+                                               uncalled);
+                cmpresult = _mm_andnot_si128(uncalled, cmpresult);
+            }
 
-#ifdef WITH_SSE2
+            /* Tally mismatched bases.  Subtracting 0x00 and
+             * 0xff is equivalent to adding 0 and 1,
+             * respectively.  */
+            num_mismatches_v8 = _mm_sub_epi8(num_mismatches_v8,
+                                             cmpresult);
 
-        /* Optional vectorized implementation (about twice as fast as
-         * nonvectorized on x86_64).  */
+            /* Tally quality scores for mismatched bases.
+             */
 
-        while (len >= 16) {
+            /* Get minimum of each quality score.  */
+            __m128i qmin_v8 = _mm_min_epu8(q1_v8, q2_v8);
 
-            /* 16 x 8 bit counters for number of mismatches  */
-            __m128i num_mismatches_v8 = _mm_set1_epi8(0);
+            /* Select only quality scores at mismatch sites
+             */
+            __m128i qadd_v8 = qmin_v8 & cmpresult;
 
-            /* 8 x 16 bit counters for mismatch quality total  */
-            __m128i mismatch_qual_total_v16 = _mm_set1_epi16(0);
+            /* Double the precision (8 => 16 bits) and tally  */
+            __m128i qadd_v16_1 = _mm_unpacklo_epi8(qadd_v8,
+                                                   _mm_set1_epi8(0));
 
-            /* The counters of num_mismatches_v8 will overflow if
-             * 256 mismatches are detected at the same position
-             * modulo 16 bytes.  So, don't process 4096 or more
-             * bytes before reducing the counters.
-             *
-             * mismatch_qual_total_v16 would overflow even faster,
-             * but we use 16-bit counters for it.  */
+            __m128i qadd_v16_2 = _mm_unpackhi_epi8(qadd_v8,
+                                                   _mm_set1_epi8(0));
 
-            int todo = min(len, 255 * 16) & ~0xf;
-            len -= todo;
+            mismatch_qual_total_v16 = _mm_add_epi16(mismatch_qual_total_v16,
+                                                    qadd_v16_1);
 
-            do {
+            mismatch_qual_total_v16 = _mm_add_epi16(mismatch_qual_total_v16,
+                                                    qadd_v16_2);
 
-                /* Load 16 bases  */
-                __m128i s1_v8 = _mm_loadu_si128((const __m128i *)seq_1);
-                __m128i s2_v8 = _mm_loadu_si128((const __m128i *)seq_2);
+            /* Advance pointers  */
+            seq_1 += 16, seq_2 += 16;
+            qual_1 += 16, qual_2 += 16;
+            todo -= 16;
+        } while (todo);
 
-                /* Load 16 quality scores  */
-                __m128i q1_v8 = _mm_loadu_si128((const __m128i *)qual_1);
-                __m128i q2_v8 = _mm_loadu_si128((const __m128i *)qual_2);
+        /* Reduce the counters.  */
+        num_mismatches += hsum32_v8(num_mismatches_v8);
+        num_uncalled += hsum32_v8(num_uncalled_v8);
+        mismatch_qual_total += hsum32_v16(mismatch_qual_total_v16);
+    }
 
-                /* Compare bases with each other and negate the
-                 * result.  This will produce 0xff in bytes
-                 * where the bases differ and 0x00 in bytes
-                 * where the bases were the same.  */
-                __m128i cmpresult = ~_mm_cmpeq_epi8(s1_v8, s2_v8);
+#endif /* WITH_SSE2  */
 
-                /* Tally mismatched bases.  Subtracting 0x00 and
-                 * 0xff is equivalent to adding 0 and 1,
-                 * respectively.  */
-                num_mismatches_v8 = _mm_sub_epi8(num_mismatches_v8,
-                                                 cmpresult);
+    /* Process any remainder that wasn't processed by the vectorized
+     * implementation.  */
+    mismatch_stats_scalar(seq_1, seq_2, qual_1, qual_2, haveN, len,
+                          &num_mismatches, &mismatch_qual_total,
+                          &num_uncalled);
 
-                /* Tally quality scores for mismatched bases.
-                 */
+    *num_mismatches_ret = num_mismatches;
+    *mismatch_qual_total_ret = mismatch_qual_total;
+    *num_uncalled_ret = num_uncalled;
+}
 
-                /* Get minimum of each quality score.  */
-                __m128i qmin_v8 = _mm_min_epu8(q1_v8, q2_v8);
+#ifdef WITH_AVX2_DISPATCH
 
-                /* Select only quality scores at mismatch sites
-                 */
-                __m128i qadd_v8 = qmin_v8 & cmpresult;
+/*
+ * AVX2 implementation, 32 bases per iteration.  The tallies are summed into
+ * 64-bit lanes with _mm256_sad_epu8, so no blocking is needed to avoid
+ * counter overflow.
+ */
+__attribute__((target("avx2,popcnt"))) static void
+mismatch_stats_avx2(const char * seq_1,
+                    const char * seq_2,
+                    const char * qual_1,
+                    const char * qual_2,
+                    bool haveN,
+                    int len,
+                    unsigned * num_mismatches_ret,
+                    unsigned * mismatch_qual_total_ret,
+                    int * num_uncalled_ret)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i n_v8 = _mm256_set1_epi8('N');
+    __m256i num_mismatches_v64 = zero;
+    __m256i num_uncalled_v64 = zero;
+    __m256i mismatch_qual_total_v64 = zero;
+
+    while (len >= 32) {
+        __m256i s1_v8 = _mm256_loadu_si256((const __m256i *)seq_1);
+        __m256i s2_v8 = _mm256_loadu_si256((const __m256i *)seq_2);
+        __m256i q1_v8 = _mm256_loadu_si256((const __m256i *)qual_1);
+        __m256i q2_v8 = _mm256_loadu_si256((const __m256i *)qual_2);
+
+        /* 0xff where the bases are equal  */
+        __m256i skip = _mm256_cmpeq_epi8(s1_v8, s2_v8);
+        if (haveN) {
+            __m256i uncalled = _mm256_or_si256(_mm256_cmpeq_epi8(s1_v8, n_v8),
+                                               _mm256_cmpeq_epi8(s2_v8, n_v8));
+            num_uncalled_v64 = _mm256_add_epi64(num_uncalled_v64,
+                    _mm256_sad_epu8(_mm256_and_si256(uncalled, one), zero));
+            skip = _mm256_or_si256(skip, uncalled);
+        }
+
+        num_mismatches_v64 = _mm256_add_epi64(num_mismatches_v64,
+                _mm256_sad_epu8(_mm256_andnot_si256(skip, one), zero));
+
+        __m256i qadd_v8 = _mm256_andnot_si256(skip,
+                                              _mm256_min_epu8(q1_v8, q2_v8));
+        mismatch_qual_total_v64 = _mm256_add_epi64(mismatch_qual_total_v64,
+                                                   _mm256_sad_epu8(qadd_v8, zero));
+
+        seq_1 += 32, seq_2 += 32;
+        qual_1 += 32, qual_2 += 32;
+        len -= 32;
+    }
+
+    /* Reduce the 4 x 64 bit counters.  */
+    __m256i sums = _mm256_add_epi64(num_mismatches_v64,
+                                    _mm256_slli_epi64(num_uncalled_v64, 32));
+    __m128i sums_v128 = _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                      _mm256_extracti128_si256(sums, 1));
+    sums_v128 = _mm_add_epi64(sums_v128, _mm_unpackhi_epi64(sums_v128, sums_v128));
+    uint64_t packed = (uint64_t)_mm_cvtsi128_si64(sums_v128);
+    __m128i qual_v128 = _mm_add_epi64(_mm256_castsi256_si128(mismatch_qual_total_v64),
+                                      _mm256_extracti128_si256(mismatch_qual_total_v64, 1));
+    qual_v128 = _mm_add_epi64(qual_v128, _mm_unpackhi_epi64(qual_v128, qual_v128));
+
+    unsigned num_mismatches = (unsigned)(packed & 0xffffffff);
+    int num_uncalled = (int)(packed >> 32);
+    unsigned mismatch_qual_total = (unsigned)_mm_cvtsi128_si64(qual_v128);
+
+    /* Overlaps are short, so a half-width step keeps most of the remainder
+     * out of the scalar loop.  */
+    if (len >= 16) {
+        __m128i s1_v8 = _mm_loadu_si128((const __m128i *)seq_1);
+        __m128i s2_v8 = _mm_loadu_si128((const __m128i *)seq_2);
+        __m128i q1_v8 = _mm_loadu_si128((const __m128i *)qual_1);
+        __m128i q2_v8 = _mm_loadu_si128((const __m128i *)qual_2);
+
+        __m128i skip = _mm_cmpeq_epi8(s1_v8, s2_v8);
+        if (haveN) {
+            __m128i uncalled = _mm_or_si128(_mm_cmpeq_epi8(s1_v8, _mm256_castsi256_si128(n_v8)),
+                                            _mm_cmpeq_epi8(s2_v8, _mm256_castsi256_si128(n_v8)));
+            num_uncalled += __builtin_popcount(_mm_movemask_epi8(uncalled));
+            skip = _mm_or_si128(skip, uncalled);
+        }
+        num_mismatches += 16 - __builtin_popcount(_mm_movemask_epi8(skip));
 
-                /* Double the precision (8 => 16 bits) and tally  */
-                __m128i qadd_v16_1 = _mm_unpacklo_epi8(qadd_v8,
-                                                       _mm_set1_epi8(0));
+        __m128i qadd_v8 = _mm_andnot_si128(skip, _mm_min_epu8(q1_v8, q2_v8));
+        __m128i qsum = _mm_sad_epu8(qadd_v8, _mm_setzero_si128());
+        mismatch_qual_total += (unsigned)_mm_cvtsi128_si32(qsum) +
+                               (unsigned)_mm_extract_epi16(qsum, 4);
 
-                __m128i qadd_v16_2 = _mm_unpackhi_epi8(qadd_v8,
-                                                       _mm_set1_epi8(0));
+        seq_1 += 16, seq_2 += 16;
+        qual_1 += 16, qual_2 += 16;
+        len -= 16;
+    }
+
+    mismatch_stats_scalar(seq_1, seq_2, qual_1, qual_2, haveN, len,
+                          &num_mismatches, &mismatch_qual_total,
+                          &num_uncalled);
 
-                mismatch_qual_total_v16 = _mm_add_epi16(mismatch_qual_total_v16,
-                                                        qadd_v16_1);
+    *num_mismatches_ret = num_mismatches;
+    *mismatch_qual_total_ret = mismatch_qual_total;
+    *num_uncalled_ret = num_uncalled;
+}
 
-                mismatch_qual_total_v16 = _mm_add_epi16(mismatch_qual_total_v16,
-                                                        qadd_v16_2);
+#endif /* WITH_AVX2_DISPATCH */
 
-                /* Advance pointers  */
-                seq_1 += 16, seq_2 += 16;
-                qual_1 += 16, qual_2 += 16;
-                todo -= 16;
-            } while (todo);
+#ifdef WITH_AVX512_DISPATCH
 
-            /* Reduce the counters.  */
-            num_mismatches += hsum32_v8(num_mismatches_v8);
-            mismatch_qual_total += hsum32_v16(mismatch_qual_total_v16);
+/*
+ * AVX-512BW implementation, 64 bases per iteration.  Comparisons produce
+ * mask registers that are counted with popcnt, and the remainder is handled
+ * with a masked load instead of the scalar loop.
+ */
+__attribute__((target("avx512f,avx512bw,popcnt"))) static void
+mismatch_stats_avx512(const char * seq_1,
+                      const char * seq_2,
+                      const char * qual_1,
+                      const char * qual_2,
+                      bool haveN,
+                      int len,
+                      unsigned * num_mismatches_ret,
+                      unsigned * mismatch_qual_total_ret,
+                      int * num_uncalled_ret)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i n_v8 = _mm512_set1_epi8('N');
+    unsigned num_mismatches = 0;
+    int num_uncalled = 0;
+    __m512i mismatch_qual_total_v64 = zero;
+
+    while (len > 0) {
+        __mmask64 valid = (len >= 64) ? ~(__mmask64)0
+                                      : (((__mmask64)1 << len) - 1);
+        __m512i s1_v8 = _mm512_maskz_loadu_epi8(valid, seq_1);
+        __m512i s2_v8 = _mm512_maskz_loadu_epi8(valid, seq_2);
+        __m512i q1_v8 = _mm512_maskz_loadu_epi8(valid, qual_1);
+        __m512i q2_v8 = _mm512_maskz_loadu_epi8(valid, qual_2);
+
+        /* Zeroed lanes beyond the end compare equal  */
+        __mmask64 mismatch = _mm512_cmpneq_epi8_mask(s1_v8, s2_v8);
+        if (haveN) {
+            __mmask64 uncalled = valid &
+                                 (_mm512_cmpeq_epi8_mask(s1_v8, n_v8) |
+                                  _mm512_cmpeq_epi8_mask(s2_v8, n_v8));
+            num_uncalled += __builtin_popcountll(uncalled);
+            mismatch &= ~uncalled;
         }
+        num_mismatches += __builtin_popcountll(mismatch);
 
-#endif /* WITH_SSE2  */
+        __m512i qadd_v8 = _mm512_maskz_mov_epi8(mismatch,
+                                                _mm512_min_epu8(q1_v8, q2_v8));
+        mismatch_qual_total_v64 = _mm512_add_epi64(mismatch_qual_total_v64,
+                                                   _mm512_sad_epu8(qadd_v8, zero));
+
+        seq_1 += 64, seq_2 += 64;
+        qual_1 += 64, qual_2 += 64;
+        len -= 64;
+    }
+
+    uint64_t qual_totals[8];
+    _mm512_storeu_si512((void *)qual_totals, mismatch_qual_total_v64);
+    uint64_t mismatch_qual_total = 0;
+    for (int i = 0; i < 8; i++) {
+        mismatch_qual_total += qual_totals[i];
+    }
+
+    *num_mismatches_ret = num_mismatches;
+    *mismatch_qual_total_ret = (unsigned)mismatch_qual_total;
+    *num_uncalled_ret = num_uncalled;
+}
+
+#endif /* WITH_AVX512_DISPATCH */
 
-#if 0
-        /* Verify the values computed by the vectorized implementation.
-		 */
-		{
-			int veclen = *len_p & ~0xf;
-			const char *_seq_1 = seq_1 - veclen;
-			const char *_seq_2 = seq_2 - veclen;
-			const char *_qual_1 = qual_1 - veclen;
-			const char *_qual_2 = qual_2 - veclen;
-			unsigned _num_mismatches = 0;
-			unsigned _mismatch_qual_total = 0;
-			for (int i = 0; i < veclen; i++) {
-				if (_seq_1[i] != _seq_2[i])  {
-					_num_mismatches++;
-					_mismatch_qual_total += min(_qual_1[i], _qual_2[i]);
-				}
-			}
-			assert(num_mismatches == _num_mismatches);
-			assert(mismatch_qual_total == _mismatch_qual_total);
-		}
+/* Overlaps are scored in chunks of this many bases, after each of which an
+ * offset that can no longer beat the best one is abandoned.  */
+#define MISMATCH_CHUNK 32
+
+/* Limits of the k-mer seeded offset search.  */
+#define SEED_MAX_LEN 1024
+#define SEED_HASH_BITS 10
+
+typedef void (*mismatch_stats_fn)(const char *, const char *,
+                                  const char *, const char *,
+                                  bool, int, unsigned *, unsigned *, int *);
+
+/* Select the widest implementation supported by the running CPU.  */
+static mismatch_stats_fn
+select_mismatch_stats()
+{
+#if defined(WITH_AVX2_DISPATCH) || defined(WITH_AVX512_DISPATCH)
+    __builtin_cpu_init();
 #endif
+#ifdef WITH_AVX512_DISPATCH
+    if (__builtin_cpu_supports("avx512bw")) {
+        return mismatch_stats_avx512;
+    }
+#endif
+#ifdef WITH_AVX2_DISPATCH
+    if (__builtin_cpu_supports("avx2")) {
+        return mismatch_stats_avx2;
+    }
+#endif
+    return mismatch_stats_default;
+}
 
-        /* Process any remainder that wasn't processed by the vectorized
-         * implementation.  */
-        for (int i = 0; i < len; i++) {
-            if (seq_1[i] != seq_2[i])  {
-                num_mismatches++;
-                mismatch_qual_total += min(qual_1[i], qual_2[i]);
-            }
-        }
+static const mismatch_stats_fn mismatch_stats_impl = select_mismatch_stats();
+
+/*
+ * Compute mismatch statistics between two sequences.
+ *
+ * @seq_1, @seq_2:
+ *	The two sequences to compare (ASCII characters A, C, G, T, N).
+ * @qual_1, @qual_2:
+ *	Quality scores for the two sequences, based at 0.
+ * @haveN
+ *	As an optimization, this can be set to %false to indicate that neither
+ *	sequence contains an uncalled base (represented as an N character).
+ * @max_mismatches
+ *	Stop early and return %false as soon as more mismatches than this have
+ *	been counted.  Nothing is written to the pointer arguments in that case.
+ * @len_p
+ *	Pointer to the length of the sequence.  This value will be updated to
+ *	subtract the number of positions at which an uncalled base (N) exists in
+ *	either sequence.
+ * @num_mismatches_ret
+ *	Location into which to return the number of positions at which the bases
+ *	were mismatched.
+ * @mismatch_qual_total_ret
+ *	Location into which to return the sum of lesser quality scores at
+ *	mismatch sites.
+ */
+static inline bool
+compute_mismatch_stats(const char * seq_1,
+                       const char * seq_2,
+                       const char * qual_1,
+                       const char * qual_2,
+                       bool haveN,
+                       unsigned max_mismatches,
+                       int * len_p,
+                       unsigned * num_mismatches_ret,
+                       unsigned * mismatch_qual_total_ret)
+{
+    int len = *len_p;
+    int num_uncalled = 0;
+    unsigned num_mismatches = 0;
+    unsigned mismatch_qual_total = 0;
+
+    for (int pos = 0; pos < len; pos += MISMATCH_CHUNK) {
+        int chunk_uncalled;
+        unsigned chunk_mismatches;
+        unsigned chunk_qual_total;
+
+        mismatch_stats_impl(seq_1 + pos, seq_2 + pos,
+                            qual_1 + pos, qual_2 + pos,
+                            haveN, min(MISMATCH_CHUNK, len - pos),
+                            &chunk_mismatches, &chunk_qual_total,
+                            &chunk_uncalled);
+        num_uncalled += chunk_uncalled;
+        num_mismatches += chunk_mismatches;
+        mismatch_qual_total += chunk_qual_total;
+
+        if (num_mismatches > max_mismatches)
+            return false;
     }
 
     /* Return results in pointer arguments  */
     *num_mismatches_ret = num_mismatches;
     *mismatch_qual_total_ret = mismatch_qual_total;
     *len_p -= num_uncalled;
+    return true;
+}
+
+/*
+ * Largest number of mismatches in an overlap scored with @score_len that still
+ * gives a mismatch density of at most @density.  Computed with the same float
+ * division as pair_align(), so abandoning an offset above this count never
+ * changes which alignment is chosen.
+ */
+static inline unsigned
+max_mismatches_within(float density, float score_len)
+{
+    unsigned limit = (unsigned)(density * score_len);
+    while ((float)(limit + 1) / score_len <= density)
+        limit++;
+    return limit;
+}
+
+/* 2-bit code of a base, or -1 for anything that is not A, C, G or T.  */
+static inline int
+seed_base_code(char c)
+{
+    switch (c) {
+        case 'A': return 0;
+        case 'C': return 1;
+        case 'G': return 2;
+        case 'T': return 3;
+        default:  return -1;
+    }
+}
+
+static inline unsigned
+seed_hash(uint32_t code)
+{
+    return (code * 2654435761u) >> (32 - SEED_HASH_BITS);
+}
+
+/*
+ * Marks in @candidates (indexed by offset - @start) every offset in [@start,
+ * @end) at which @read_1 and @read_2 share an exact k-mer of length @k.  Reads
+ * longer than SEED_MAX_LEN are not seeded and %false is returned, in which
+ * case every offset has to be scored.
+ */
+static bool
+seed_offsets(const struct read *read_1, const struct read *read_2, int k,
+             int start, int end, unsigned char *candidates)
+{
+    int head[1 << SEED_HASH_BITS];
+    int next[SEED_MAX_LEN];
+    uint32_t codes[SEED_MAX_LEN];
+    const uint32_t kmer_mask = (k == 16) ? 0xffffffffu : ((1u << (2 * k)) - 1);
+
+    if (read_1->seq_len > SEED_MAX_LEN || read_2->seq_len > SEED_MAX_LEN)
+        return false;
+
+    memset(head, 0xff, sizeof(head));
+    memset(candidates, 0, max(end - start, 0));
+
+    /* Index the k-mers of read 2 by their start position.  */
+    uint32_t code = 0;
+    int valid = 0;
+    for (int q = 0; q < read_2->seq_len; q++) {
+        int c = seed_base_code(read_2->seq[q]);
+        if (c < 0) {
+            valid = 0;
+            continue;
+        }
+        code = ((code << 2) | c) & kmer_mask;
+        if (++valid >= k) {
+            int pos = q - k + 1;
+            unsigned bucket = seed_hash(code);
+            codes[pos] = code;
+            next[pos] = head[bucket];
+            head[bucket] = pos;
+        }
+    }
+
+    /* A k-mer at position p of read 1 and q of read 2 supports offset p - q.  */
+    code = 0;
+    valid = 0;
+    for (int p = 0; p < read_1->seq_len; p++) {
+        int c = seed_base_code(read_1->seq[p]);
+        if (c < 0) {
+            valid = 0;
+            continue;
+        }
+        code = ((code << 2) | c) & kmer_mask;
+        if (++valid < k)
+            continue;
+        int pos = p - k + 1;
+        for (int q = head[seed_hash(code)]; q >= 0; q = next[q]) {
+            int offset = pos - q;
+            if (codes[q] == code && offset >= start && offset < end)
+                candidates[offset - start] = 1;
+        }
+    }
+    return true;
 }
 
 #define NO_ALIGNMENT INT_MIN
@@ -268,7 +628,7 @@ compute_mismatch_stats(const char * seq_1,
 static inline int
 pair_align(const struct read *read_1, const struct read *read_2,
            int min_overlap, int max_overlap, float max_mismatch_density,
-           bool allow_outies, bool * was_outie)
+           bool allow_outies, int seed_kmer_len, bool * was_outie)
 {
     bool haveN = memchr(read_1->seq, 'N', read_1->seq_len) ||
                  memchr(read_2->seq, 'N', read_2->seq_len);
@@ -282,6 +642,8 @@ pair_align(const struct read *read_1, const struct read *read_2,
     bool doing_outie = false;
     int start;
     int end;
+    bool seeded;
+    unsigned char candidates[SEED_MAX_LEN];
 
     again:
     /* Require at least min_overlap bases overlap, and require that the
@@ -289,19 +651,32 @@ pair_align(const struct read *read_1, const struct read *read_2,
      * the first read.  */
     start = max(0, read_1->seq_len - read_2->seq_len);
     end = read_1->seq_len - min_overlap + 1;
+    seeded = seed_kmer_len > 0 &&
+             seed_offsets(read_1, read_2, seed_kmer_len, start, end, candidates);
     for (int i = start; i < end; i++) {
         unsigned num_mismatches;
         unsigned mismatch_qual_total;
         int overlap_len = read_1->seq_len - i;
 
-        compute_mismatch_stats(read_1->seq + i,
-                               read_2->seq,
-                               read_1->qual + i,
-                               read_2->qual,
-                               haveN,
-                               &overlap_len,
-                               &num_mismatches,
-                               &mismatch_qual_total);
+        if (seeded && !candidates[i - start])
+            continue;
+
+        /* Only offsets that can still reach the best density found so far
+         * (or the maximum allowed density) are scored to the end.  */
+        unsigned max_mismatches = max_mismatches_within(
+                min(best_mismatch_density, max_mismatch_density),
+                (float)min(overlap_len, max_overlap));
+
+        if (!compute_mismatch_stats(read_1->seq + i,
+                                    read_2->seq,
+                                    read_1->qual + i,
+                                    read_2->qual,
+                                    haveN,
+                                    max_mismatches,
+                                    &overlap_len,
+                                    &num_mismatches,
+                                    &mismatch_qual_total))
+            continue;
 
         if (overlap_len >= min_overlap) {
             float score_len = (float)min(overlap_len, max_overlap);
@@ -360,16 +735,8 @@ generate_combined_read(const struct read *read_1,
     char * combined_seq;
     char * combined_qual;
 
-    if (combined_read->seq_bufsz < combined_seq_len) {
-        combined_read->seq = (char *)xrealloc(combined_read->seq,
-                                      combined_seq_len);
-        combined_read->seq_bufsz = combined_seq_len;
-    }
-    if (combined_read->qual_bufsz < combined_seq_len) {
-        combined_read->qual = (char *)xrealloc(combined_read->qual,
-                                       combined_seq_len);
-        combined_read->qual_bufsz = combined_seq_len;
-    }
+    /* Only allocates if the caller did not reserve enough.  */
+    read_reserve(combined_read, combined_seq_len);
 
     combined_seq = combined_read->seq;
     combined_qual = combined_read->qual;
@@ -448,6 +815,46 @@ generate_combined_read(const struct read *read_1,
     }
 }
 
+/* Fills in the combined read for an alignment found by pair_align() and
+ * returns the combination status.  */
+static enum combine_status
+finish_combined_read(const struct read *read_1, const struct read *read_2,
+                     struct read *combined_read, int overlap_begin,
+                     bool was_outie, bool cap_mismatch_quals)
+{
+    enum combine_status status;
+
+    if (!was_outie) {
+        status = COMBINED_AS_INNIE;
+    } else {
+        const struct read *tmp;
+
+        /* Simplify generation of the combined read by turning the outie
+         * case into the innie case.  */
+
+        tmp = read_1;
+        read_1 = read_2;
+        read_2 = tmp;
+
+        status = COMBINED_AS_OUTIE;
+        /*
+         * Now it's just:
+         *
+         *		0	  overlap_begin
+         *	        |         |
+         *	Read 1: ------------------>
+         *	Read 2:           ---------------------->
+         *
+         * The same as the "innie" case.
+         */
+    }
+
+    /* Fill in the combined read.  */
+    generate_combined_read(read_1, read_2, combined_read,
+                           overlap_begin, cap_mismatch_quals);
+    return status;
+}
+
 /* This is the entry point for the core algorithm of FLASH.  The following
  * function attempts to combine @read_1 with @read_2, and writes the result into
  * @combined_read.  COMBINED_AS_INNIE or COMBINED_AS_OUTIE is returned if
@@ -477,7 +884,6 @@ combine_reads(const struct read *read_1, const struct read *read_2,
               const struct combine_params *params)
 {
     int overlap_begin;
-    enum combine_status status;
     bool was_outie;
 
     /* Do the alignment.  */
@@ -487,6 +893,7 @@ combine_reads(const struct read *read_1, const struct read *read_2,
                                params->max_overlap,
                                params->max_mismatch_density,
                                params->allow_outies,
+                               params->seed_kmer_len,
                                &was_outie);
     /*
      * If overlap_begin == NO_ALIGNMENT, then no sufficient overlap between
@@ -514,35 +921,437 @@ combine_reads(const struct read *read_1, const struct read *read_2,
     if (overlap_begin == NO_ALIGNMENT)
         return NOT_COMBINED;
 
-    if (!was_outie) {
-        status = COMBINED_AS_INNIE;
-    } else {
-        const struct read *tmp;
+    return finish_combined_read(read_1, read_2, combined_read, overlap_begin,
+                                was_outie, params->cap_mismatch_quals);
+}
 
-        /* Simplify generation of the combined read by turning the outie
-         * case into the innie case.  */
+/* Reads up to this length are aligned in batches, longer ones one by one.  */
+#define BATCH_MAX_LEN 512
 
-        tmp = read_1;
-        read_1 = read_2;
-        read_2 = tmp;
+/* Bases and quality scores of COMBINE_BATCH_SIZE reads, transposed so that
+ * each row holds one position of all reads.  */
+struct batch_columns {
+    alignas(32) unsigned char seq[BATCH_MAX_LEN][COMBINE_BATCH_SIZE];
+    alignas(32) unsigned char qual[BATCH_MAX_LEN][COMBINE_BATCH_SIZE];
+};
 
-        status = COMBINED_AS_OUTIE;
-        /*
-         * Now it's just:
-         *
-         *		0	  overlap_begin
-         *	        |         |
-         *	Read 1: ------------------>
-         *	Read 2:           ---------------------->
-         *
-         * The same as the "innie" case.
-         */
+/* Lanes without a read are filled with @pad, different for the two reads of
+ * a pair, so that they mismatch everywhere and never keep an offset from being
+ * abandoned.  */
+static void
+transpose_reads(const struct read *reads, const int *indices, int num_reads,
+                int len, unsigned char pad, struct batch_columns *columns)
+{
+    memset(columns->seq, pad, (size_t)len * COMBINE_BATCH_SIZE);
+    memset(columns->qual, 0, (size_t)len * COMBINE_BATCH_SIZE);
+    for (int lane = 0; lane < num_reads; lane++) {
+        const struct read *r = &reads[indices[lane]];
+        for (int pos = 0; pos < len; pos++) {
+            columns->seq[pos][lane] = r->seq[pos];
+            columns->qual[pos][lane] = r->qual[pos];
+        }
     }
+}
 
-    /* Fill in the combined read.  */
-    generate_combined_read(read_1, read_2, combined_read,
-                           overlap_begin, params->cap_mismatch_quals);
-    return status;
+/* Pairs are grouped by read lengths within windows of this many pairs.  */
+#define BATCH_WINDOW 1024
+
+struct batch_key {
+    int len_1;
+    int len_2;
+    int index;
+};
+
+static int
+compare_batch_keys(const void *p1, const void *p2)
+{
+    const struct batch_key *k1 = (const struct batch_key *)p1;
+    const struct batch_key *k2 = (const struct batch_key *)p2;
+    if (k1->len_1 != k2->len_1)
+        return k1->len_1 - k2->len_1;
+    if (k1->len_2 != k2->len_2)
+        return k1->len_2 - k2->len_2;
+    return k1->index - k2->index;
+}
+
+/*
+ * Same as compute_mismatch_stats(), but for one offset of all reads of a
+ * batch at once: row @offset + t of @a is compared with row t of @b for the
+ * @len positions of the overlap.  Positions with an N are always masked.
+ * Scoring stops early once every lane has more than @max_mismatches, the
+ * counts of such lanes are then partial.
+ */
+typedef void (*batch_mismatch_stats_fn)(const struct batch_columns *,
+                                        const struct batch_columns *,
+                                        int, int, const unsigned *,
+                                        unsigned *, unsigned *, int *);
+
+/* Adds the counters of one block to the totals and returns whether all lanes
+ * are above their mismatch limit.  */
+static inline bool
+batch_reduce_block(const unsigned char *mismatches,
+                   const unsigned char *uncalled,
+                   const uint16_t *quals,
+                   const unsigned *max_mismatches,
+                   unsigned *num_mismatches,
+                   unsigned *mismatch_qual_total,
+                   int *num_uncalled)
+{
+    bool abandon = true;
+    for (int lane = 0; lane < COMBINE_BATCH_SIZE; lane++) {
+        num_mismatches[lane] += mismatches[lane];
+        num_uncalled[lane] += uncalled[lane];
+        mismatch_qual_total[lane] += quals[lane];
+        abandon &= num_mismatches[lane] > max_mismatches[lane];
+    }
+    return abandon;
+}
+
+static void
+batch_mismatch_stats_default(const struct batch_columns *a,
+                             const struct batch_columns *b,
+                             int offset, int len,
+                             const unsigned *max_mismatches,
+                             unsigned *num_mismatches,
+                             unsigned *mismatch_qual_total,
+                             int *num_uncalled)
+{
+    for (int lane = 0; lane < COMBINE_BATCH_SIZE; lane++) {
+        num_mismatches[lane] = 0;
+        mismatch_qual_total[lane] = 0;
+        num_uncalled[lane] = 0;
+    }
+
+    int t = 0;
+    while (t < len) {
+        /* The counters are reduced every MISMATCH_CHUNK positions, well
+         * before the 8 bit counters could overflow.  */
+        int todo = min(len - t, MISMATCH_CHUNK);
+        alignas(16) unsigned char mismatches[COMBINE_BATCH_SIZE];
+        alignas(16) unsigned char uncalled[COMBINE_BATCH_SIZE];
+        alignas(16) uint16_t quals[COMBINE_BATCH_SIZE];
+
+#ifdef WITH_SSE2
+        const __m128i n_v8 = _mm_set1_epi8('N');
+        const __m128i zero = _mm_set1_epi8(0);
+
+        /* 16 lanes at a time  */
+        for (int h = 0; h < COMBINE_BATCH_SIZE; h += 16) {
+            __m128i num_mismatches_v8 = zero;
+            __m128i num_uncalled_v8 = zero;
+            __m128i qual_lo_v16 = zero;
+            __m128i qual_hi_v16 = zero;
+
+            for (int r = t; r < t + todo; r++) {
+                __m128i s1_v8 = _mm_load_si128((const __m128i *)&a->seq[offset + r][h]);
+                __m128i s2_v8 = _mm_load_si128((const __m128i *)&b->seq[r][h]);
+                __m128i q1_v8 = _mm_load_si128((const __m128i *)&a->qual[offset + r][h]);
+                __m128i q2_v8 = _mm_load_si128((const __m128i *)&b->qual[r][h]);
+
+                __m128i uncalled_v8 = _mm_cmpeq_epi8(s1_v8, n_v8) |
+                                      _mm_cmpeq_epi8(s2_v8, n_v8);
+                __m128i mismatch = ~(_mm_cmpeq_epi8(s1_v8, s2_v8) | uncalled_v8);
+
+                num_uncalled_v8 = _mm_sub_epi8(num_uncalled_v8, uncalled_v8);
+                num_mismatches_v8 = _mm_sub_epi8(num_mismatches_v8, mismatch);
+
+                __m128i qadd_v8 = _mm_min_epu8(q1_v8, q2_v8) & mismatch;
+                qual_lo_v16 = _mm_add_epi16(qual_lo_v16,
+                                            _mm_unpacklo_epi8(qadd_v8, zero));
+                qual_hi_v16 = _mm_add_epi16(qual_hi_v16,
+                                            _mm_unpackhi_epi8(qadd_v8, zero));
+            }
+
+            _mm_store_si128((__m128i *)(mismatches + h), num_mismatches_v8);
+            _mm_store_si128((__m128i *)(uncalled + h), num_uncalled_v8);
+            _mm_store_si128((__m128i *)(quals + h), qual_lo_v16);
+            _mm_store_si128((__m128i *)(quals + h + 8), qual_hi_v16);
+        }
+#else
+        memset(mismatches, 0, sizeof(mismatches));
+        memset(uncalled, 0, sizeof(uncalled));
+        memset(quals, 0, sizeof(quals));
+        for (int r = t; r < t + todo; r++) {
+            const unsigned char *s1 = a->seq[offset + r];
+            const unsigned char *s2 = b->seq[r];
+            const unsigned char *q1 = a->qual[offset + r];
+            const unsigned char *q2 = b->qual[r];
+            for (int lane = 0; lane < COMBINE_BATCH_SIZE; lane++) {
+                if (s1[lane] == 'N' || s2[lane] == 'N') {
+                    uncalled[lane]++;
+                } else if (s1[lane] != s2[lane]) {
+                    mismatches[lane]++;
+                    quals[lane] += min(q1[lane], q2[lane]);
+                }
+            }
+        }
+#endif
+        t += todo;
+
+        if (batch_reduce_block(mismatches, uncalled, quals, max_mismatches,
+                               num_mismatches, mismatch_qual_total,
+                               num_uncalled))
+            return;
+    }
+}
+
+#ifdef WITH_AVX2_DISPATCH
+
+/* AVX2 implementation, all 32 lanes of a row in one vector.  */
+__attribute__((target("avx2"))) static void
+batch_mismatch_stats_avx2(const struct batch_columns *a,
+                          const struct batch_columns *b,
+                          int offset, int len,
+                          const unsigned *max_mismatches,
+                          unsigned *num_mismatches,
+                          unsigned *mismatch_qual_total,
+                          int *num_uncalled)
+{
+    const __m256i n_v8 = _mm256_set1_epi8('N');
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (int lane = 0; lane < COMBINE_BATCH_SIZE; lane++) {
+        num_mismatches[lane] = 0;
+        mismatch_qual_total[lane] = 0;
+        num_uncalled[lane] = 0;
+    }
+
+    int t = 0;
+    while (t < len) {
+        int todo = min(len - t, MISMATCH_CHUNK);
+        __m256i num_mismatches_v8 = zero;
+        __m256i num_uncalled_v8 = zero;
+        __m256i qual_lo_v16 = zero;
+        __m256i qual_hi_v16 = zero;
+
+        for (int end = t + todo; t < end; t++) {
+            __m256i s1_v8 = _mm256_load_si256((const __m256i *)a->seq[offset + t]);
+            __m256i s2_v8 = _mm256_load_si256((const __m256i *)b->seq[t]);
+            __m256i q1_v8 = _mm256_load_si256((const __m256i *)a->qual[offset + t]);
+            __m256i q2_v8 = _mm256_load_si256((const __m256i *)b->qual[t]);
+
+            __m256i uncalled_v8 = _mm256_or_si256(_mm256_cmpeq_epi8(s1_v8, n_v8),
+                                                  _mm256_cmpeq_epi8(s2_v8, n_v8));
+            /* 0xff where the lane is no mismatch  */
+            __m256i skip = _mm256_or_si256(_mm256_cmpeq_epi8(s1_v8, s2_v8),
+                                           uncalled_v8);
+
+            num_uncalled_v8 = _mm256_sub_epi8(num_uncalled_v8, uncalled_v8);
+            /* Adding 0xff and subtracting 0xff cancel out, so this counts
+             * the lanes that are mismatches.  */
+            num_mismatches_v8 = _mm256_add_epi8(num_mismatches_v8,
+                                                _mm256_add_epi8(skip, _mm256_set1_epi8(1)));
+
+            __m256i qadd_v8 = _mm256_andnot_si256(skip, _mm256_min_epu8(q1_v8, q2_v8));
+            qual_lo_v16 = _mm256_add_epi16(qual_lo_v16,
+                    _mm256_cvtepu8_epi16(_mm256_castsi256_si128(qadd_v8)));
+            qual_hi_v16 = _mm256_add_epi16(qual_hi_v16,
+                    _mm256_cvtepu8_epi16(_mm256_extracti128_si256(qadd_v8, 1)));
+        }
+
+        alignas(32) unsigned char mismatches[COMBINE_BATCH_SIZE];
+        alignas(32) unsigned char uncalled[COMBINE_BATCH_SIZE];
+        alignas(32) uint16_t quals[COMBINE_BATCH_SIZE];
+        _mm256_store_si256((__m256i *)mismatches, num_mismatches_v8);
+        _mm256_store_si256((__m256i *)uncalled, num_uncalled_v8);
+        _mm256_store_si256((__m256i *)quals, qual_lo_v16);
+        _mm256_store_si256((__m256i *)(quals + 16), qual_hi_v16);
+
+        if (batch_reduce_block(mismatches, uncalled, quals, max_mismatches,
+                               num_mismatches, mismatch_qual_total,
+                               num_uncalled))
+            return;
+    }
+}
+
+#endif /* WITH_AVX2_DISPATCH */
+
+static batch_mismatch_stats_fn
+select_batch_mismatch_stats()
+{
+#ifdef WITH_AVX2_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return batch_mismatch_stats_avx2;
+    }
+#endif
+    return batch_mismatch_stats_default;
+}
+
+static const batch_mismatch_stats_fn batch_mismatch_stats =
+        select_batch_mismatch_stats();
+
+/*
+ * pair_align() for a batch of @num_pairs read pairs that all have the same
+ * read lengths.  Every offset is evaluated for all pairs in one pass, in the
+ * same order and with the same scores as pair_align(), so the chosen
+ * alignments are identical.
+ */
+static void
+pair_align_batch(const struct batch_columns *columns_1,
+                 const struct batch_columns *columns_2,
+                 int len_1, int len_2, int num_pairs,
+                 int min_overlap, int max_overlap, float max_mismatch_density,
+                 bool allow_outies,
+                 int best_position[COMBINE_BATCH_SIZE],
+                 bool best_was_outie[COMBINE_BATCH_SIZE])
+{
+    float best_mismatch_density[COMBINE_BATCH_SIZE];
+    float best_qual_score[COMBINE_BATCH_SIZE];
+    unsigned max_mismatches[COMBINE_BATCH_SIZE];
+    unsigned num_mismatches[COMBINE_BATCH_SIZE];
+    unsigned mismatch_qual_total[COMBINE_BATCH_SIZE];
+    int num_uncalled[COMBINE_BATCH_SIZE];
+
+    float limit_density[COMBINE_BATCH_SIZE];
+    float limit_score_len = -1.0f;
+    for (int lane = num_pairs; lane < COMBINE_BATCH_SIZE; lane++)
+        max_mismatches[lane] = 0;
+
+    for (int lane = 0; lane < num_pairs; lane++) {
+        limit_density[lane] = -1.0f;
+        best_mismatch_density[lane] = max_mismatch_density + 1.0f;
+        best_qual_score[lane] = 0.0f;
+        best_position[lane] = NO_ALIGNMENT;
+        best_was_outie[lane] = false;
+    }
+
+    for (int pass = 0; pass < (allow_outies ? 2 : 1); pass++) {
+        bool doing_outie = (pass == 1);
+        const struct batch_columns *a = doing_outie ? columns_2 : columns_1;
+        const struct batch_columns *b = doing_outie ? columns_1 : columns_2;
+        int len_a = doing_outie ? len_2 : len_1;
+        int len_b = doing_outie ? len_1 : len_2;
+
+        int start = max(0, len_a - len_b);
+        int end = len_a - min_overlap + 1;
+        for (int i = start; i < end; i++) {
+            /* The limits only change with the score length, which is the
+             * same for all lanes, or when a lane finds a better alignment.
+             * Lanes without a pair never need to be scored.  */
+            float score_cap = (float)min(len_a - i, max_overlap);
+            for (int lane = 0; lane < num_pairs; lane++) {
+                float threshold = min(best_mismatch_density[lane], max_mismatch_density);
+                if (threshold != limit_density[lane] || score_cap != limit_score_len) {
+                    max_mismatches[lane] = max_mismatches_within(threshold, score_cap);
+                    limit_density[lane] = threshold;
+                }
+            }
+            limit_score_len = score_cap;
+
+            batch_mismatch_stats(a, b, i, len_a - i, max_mismatches,
+                                 num_mismatches, mismatch_qual_total,
+                                 num_uncalled);
+
+            for (int lane = 0; lane < num_pairs; lane++) {
+                int overlap_len = len_a - i - num_uncalled[lane];
+                if (num_mismatches[lane] > max_mismatches[lane] ||
+                    overlap_len < min_overlap)
+                    continue;
+
+                float score_len = (float)min(overlap_len, max_overlap);
+                float qual_score = mismatch_qual_total[lane] / score_len;
+                float mismatch_density = num_mismatches[lane] / score_len;
+
+                if (mismatch_density <= best_mismatch_density[lane] &&
+                    (mismatch_density < best_mismatch_density[lane] ||
+                     qual_score < best_qual_score[lane]))
+                {
+                    best_qual_score[lane]       = qual_score;
+                    best_mismatch_density[lane] = mismatch_density;
+                    best_position[lane]         = i;
+                    best_was_outie[lane]        = doing_outie;
+                }
+            }
+        }
+    }
+
+    for (int lane = 0; lane < num_pairs; lane++) {
+        if (best_mismatch_density[lane] > max_mismatch_density)
+            best_position[lane] = NO_ALIGNMENT;
+    }
+}
+
+/*
+ * Batch version of combine_reads().  Pairs with the same read lengths are
+ * aligned COMBINE_BATCH_SIZE at a time, one pair per vector lane; pairs with
+ * unique lengths, long reads and k-mer seeded alignment go through
+ * combine_reads().  The results are identical to calling combine_reads() for
+ * each pair.
+ */
+void
+combine_reads_batch(const struct read *read_1, const struct read *read_2,
+                    struct read *combined_reads,
+                    enum combine_status *status,
+                    int num_pairs,
+                    const struct combine_params *params)
+{
+    struct batch_columns columns_1;
+    struct batch_columns columns_2;
+    struct batch_key keys[BATCH_WINDOW];
+    int indices[COMBINE_BATCH_SIZE];
+    int best_position[COMBINE_BATCH_SIZE];
+    bool best_was_outie[COMBINE_BATCH_SIZE];
+
+    if (params->seed_kmer_len > 0) {
+        for (int j = 0; j < num_pairs; j++) {
+            status[j] = combine_reads(&read_1[j], &read_2[j],
+                                      &combined_reads[j], params);
+        }
+        return;
+    }
+
+    for (int window = 0; window < num_pairs; window += BATCH_WINDOW) {
+        int window_size = min(num_pairs - window, BATCH_WINDOW);
+        for (int k = 0; k < window_size; k++) {
+            keys[k].len_1 = read_1[window + k].seq_len;
+            keys[k].len_2 = read_2[window + k].seq_len;
+            keys[k].index = window + k;
+        }
+        qsort(keys, window_size, sizeof(struct batch_key), compare_batch_keys);
+
+        int first = 0;
+        while (first < window_size) {
+            int len_1 = keys[first].len_1;
+            int len_2 = keys[first].len_2;
+            int count = 0;
+            while (count < COMBINE_BATCH_SIZE && first + count < window_size &&
+                   keys[first + count].len_1 == len_1 &&
+                   keys[first + count].len_2 == len_2) {
+                indices[count] = keys[first + count].index;
+                count++;
+            }
+
+            if (count == 1 || len_1 > BATCH_MAX_LEN || len_2 > BATCH_MAX_LEN) {
+                for (int lane = 0; lane < count; lane++) {
+                    int j = indices[lane];
+                    status[j] = combine_reads(&read_1[j], &read_2[j],
+                                              &combined_reads[j], params);
+                }
+            } else {
+                transpose_reads(read_1, indices, count, len_1, 0, &columns_1);
+                transpose_reads(read_2, indices, count, len_2, 1, &columns_2);
+                pair_align_batch(&columns_1, &columns_2, len_1, len_2, count,
+                                 params->min_overlap, params->max_overlap,
+                                 params->max_mismatch_density,
+                                 params->allow_outies,
+                                 best_position, best_was_outie);
+                for (int lane = 0; lane < count; lane++) {
+                    int j = indices[lane];
+                    if (best_position[lane] == NO_ALIGNMENT) {
+                        status[j] = NOT_COMBINED;
+                    } else {
+                        status[j] = finish_combined_read(&read_1[j], &read_2[j],
+                                                         &combined_reads[j],
+                                                         best_position[lane],
+                                                         best_was_outie[lane],
+                                                         params->cap_mismatch_quals);
+                    }
+                }
+            }
+            first += count;
+        }
+    }
 }
 
 
@@ -20,6 +20,10 @@ struct combine_params {
 
     /* --allow-outies  */
     bool allow_outies;
+
+    /* Only score overlaps supported by a shared k-mer of this length
+     * (1 to 16), 0 scores every offset.  */
+    int seed_kmer_len;
 };
 
 /* Result of a call to combine_reads()  */
@@ -51,4 +55,18 @@ combine_reads(const struct read *read_1, const struct read *read_2,
               struct read *combined_read,
               const struct combine_params *params);
 
+/* Number of read pairs combine_reads_batch() aligns at once.  */
+#define COMBINE_BATCH_SIZE 32
+
+/* Combines @num_pairs read pairs (@read_1[i], @read_2[i]) into
+ * @combined_reads[i] and stores the result of each in @status[i].  Pairs
+ * with equal read lengths are aligned together, which is faster than
+ * calling combine_reads() for each pair but gives the same results.  */
+extern void
+combine_reads_batch(const struct read *read_1, const struct read *read_2,
+                    struct read *combined_reads,
+                    enum combine_status *status,
+                    int num_pairs,
+                    const struct combine_params *params);
+
 #endif /* _FLASH_COMBINE_READS_H_  */
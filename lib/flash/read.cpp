@@ -1,4 +1,14 @@
 #include "read.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+/* The pshufb implementation is compiled with a target attribute and selected
+ * at runtime.  */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define WITH_SSSE3_DISPATCH
+#  include <tmmintrin.h>
+#endif
 
 
 
@@ -18,32 +28,174 @@ complement(char c)
 }
 
 
-static inline char
-identity_mapping(char c)
-{
-    return c;
-}
-
-/* Reverse a sequence of @len chars, applying the mapping function @map_char to
- * each, including the middle char if @len is odd.  */
-static inline void
-reverse_with_mapping(char *p, size_t len, char (*map_char)(char))
+/* Reverse-complements @len bases of @seq and reverses @qual (if not NULL) with
+ * them, both in place.  */
+static void
+reverse_complement_scalar(char *seq, char *qual, size_t len)
 {
-    char tmp;
-    char *pp = p + len;
+    char *p = seq;
+    char *pp = seq + len;
     while (pp > p) {
         --pp;
-        tmp = *p;
-        *p = (*map_char)(*pp);
-        *pp = (*map_char)(tmp);
+        char tmp = *p;
+        *p = complement(*pp);
+        *pp = complement(tmp);
         ++p;
     }
+    if (qual != NULL) {
+        p = qual;
+        pp = qual + len;
+        while (pp > p) {
+            --pp;
+            char tmp = *p;
+            *p = *pp;
+            *pp = tmp;
+            ++p;
+        }
+    }
+}
+
+#ifdef WITH_SSSE3_DISPATCH
+
+/* Complements 16 bases with nibble lookups into the rows 0x40-0x5f of
+ * complement_tab.  Rows 0x60-0x7f are the same in lower case, so the case bit
+ * is carried over from the input; everything else maps to '.'.  */
+__attribute__((target("ssse3"))) static inline __m128i
+complement_v8(__m128i v, const __m128i *rows)
+{
+    const __m128i low_mask = _mm_set1_epi8(0x0f);
+    const __m128i row_bit = _mm_set1_epi8(0x10);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    __m128i lo = _mm_and_si128(v, low_mask);
+    __m128i upper = _mm_shuffle_epi8(rows[0], lo);
+    __m128i lower = _mm_shuffle_epi8(rows[1], lo);
+    __m128i second_row = _mm_cmpeq_epi8(_mm_and_si128(v, row_bit), row_bit);
+    __m128i mapped = _mm_or_si128(_mm_and_si128(second_row, lower),
+                                  _mm_andnot_si128(second_row, upper));
+    mapped = _mm_or_si128(mapped, _mm_and_si128(v, case_bit));
+    __m128i in_table = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xc0)),
+                                      _mm_set1_epi8(0x40));
+    return _mm_or_si128(_mm_and_si128(in_table, mapped),
+                        _mm_andnot_si128(in_table, _mm_set1_epi8('.')));
+}
+
+/* Writes the reverse complement of the 16 bytes at @back to @front and vice
+ * versa, and reverses the quality blocks at the same positions.  */
+__attribute__((target("ssse3"))) static inline void
+swap_reverse_blocks(char *seq, char *qual, size_t front, size_t back,
+                    const __m128i *rows)
+{
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i f = _mm_loadu_si128((const __m128i *)(seq + front));
+    __m128i b = _mm_loadu_si128((const __m128i *)(seq + back));
+    _mm_storeu_si128((__m128i *)(seq + front),
+                     complement_v8(_mm_shuffle_epi8(b, reverse), rows));
+    _mm_storeu_si128((__m128i *)(seq + back),
+                     complement_v8(_mm_shuffle_epi8(f, reverse), rows));
+    if (qual != NULL) {
+        f = _mm_loadu_si128((const __m128i *)(qual + front));
+        b = _mm_loadu_si128((const __m128i *)(qual + back));
+        _mm_storeu_si128((__m128i *)(qual + front), _mm_shuffle_epi8(b, reverse));
+        _mm_storeu_si128((__m128i *)(qual + back), _mm_shuffle_epi8(f, reverse));
+    }
+}
+
+/* Swaps 16 byte blocks from both ends towards the middle.  The sequence and
+ * quality blocks are handled in the same pass.  */
+__attribute__((target("ssse3"))) static void
+reverse_complement_ssse3(char *seq, char *qual, size_t len)
+{
+    __m128i rows[2];
+    rows[0] = _mm_loadu_si128((const __m128i *)(complement_tab + 64));
+    rows[1] = _mm_loadu_si128((const __m128i *)(complement_tab + 80));
+
+    size_t front = 0;
+    size_t back = len;
+    while (back - front >= 32) {
+        back -= 16;
+        swap_reverse_blocks(seq, qual, front, back, rows);
+        front += 16;
+    }
+
+    /* Between 16 and 31 bytes left: the two blocks overlap, and both write
+     * the same values to the overlapping bytes.  */
+    if (back - front >= 16) {
+        swap_reverse_blocks(seq, qual, front, back - 16, rows);
+        front = back;
+    }
+
+    /* The rest is centered, so reversing it in place completes the read.  */
+    reverse_complement_scalar(seq + front, (qual != NULL) ? qual + front : NULL,
+                              back - front);
+}
+
+#endif /* WITH_SSSE3_DISPATCH */
+
+typedef void (*reverse_complement_fn)(char *, char *, size_t);
+
+static reverse_complement_fn
+select_reverse_complement()
+{
+#ifdef WITH_SSSE3_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        return reverse_complement_ssse3;
+    }
+#endif
+    return reverse_complement_scalar;
+}
+
+static const reverse_complement_fn reverse_complement_impl =
+        select_reverse_complement();
+
+/* Reverse-complements a sequence in place and reverses its quality scores
+ * along with it.  @qual may be NULL.  */
+extern void
+reverse_complement_seq(char *seq, char *qual, size_t len)
+{
+    reverse_complement_impl(seq, qual, len);
 }
 
 /* Reverse-complement a read in place.  */
 extern void
 reverse_complement(struct read *r)
 {
-    reverse_with_mapping(r->seq, r->seq_len, complement);
-    reverse_with_mapping(r->qual, r->seq_len, identity_mapping);
+    reverse_complement_seq(r->seq, r->qual, r->seq_len);
+}
+
+/* Grows the sequence and quality buffers of a read that owns them to hold at
+ * least @len characters.  Buffers grow at least geometrically, so a reused
+ * read stops reallocating once it has seen its longest sequence.  */
+extern void
+read_reserve(struct read *r, size_t len)
+{
+    if (r->seq_bufsz < len) {
+        size_t size = r->seq_bufsz * 2 > len ? r->seq_bufsz * 2 : len;
+        r->seq = (char *)xrealloc(r->seq, size);
+        r->seq_bufsz = size;
+    }
+    if (r->qual_bufsz < len) {
+        size_t size = r->qual_bufsz * 2 > len ? r->qual_bufsz * 2 : len;
+        r->qual = (char *)xrealloc(r->qual, size);
+        r->qual_bufsz = size;
+    }
+}
+
+/* Frees the buffers of a read that owns them and resets it to empty.  */
+extern void
+read_free_buffers(struct read *r)
+{
+    free(r->tag);
+    free(r->seq);
+    free(r->qual);
+    r->tag = NULL;
+    r->seq = NULL;
+    r->qual = NULL;
+    r->tag_len = 0;
+    r->seq_len = 0;
+    r->qual_len = 0;
+    r->tag_bufsz = 0;
+    r->seq_bufsz = 0;
+    r->qual_bufsz = 0;
 }
@@ -35,5 +35,14 @@ struct input_stream;
 extern void
 reverse_complement(struct read *r);
 
+extern void
+reverse_complement_seq(char *seq, char *qual, size_t len);
+
+extern void
+read_reserve(struct read *r, size_t len);
+
+extern void
+read_free_buffers(struct read *r);
+
 
 #endif /* _FLASH_READ_H_ */
@@ -7,48 +7,115 @@
 #include "keras_model.h"
 
 #include <cmath>
-#include <istream>
+#include <cstring>
+#include <stdint.h>
 #include <limits>
 #include <stdio.h>
 #include <utility>
-#include <sstream>
 
-bool ReadUnsignedInt(std::istream* file, unsigned int* i) {
-    KASSERT(file, "Invalid file stream");
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+// Quantized rows are padded to this many inputs, one AVX2 register of int8.
+static const int kQuantizedBlock = 32;
+
+bool KerasReader::Align() {
+    if (!aligned_) {
+        return true;
+    }
+
+    offset_ = (offset_ + kKerasAlignment - 1) / kKerasAlignment * kKerasAlignment;
+    KASSERT(offset_ <= size_, "Unexpected end of model");
+
+    return true;
+}
+
+void KerasReader::Write(const void* data, size_t n, bool align) {
+    if (record_ == NULL) {
+        return;
+    }
+
+    if (align) {
+        record_->resize((record_->size() + kKerasAlignment - 1) /
+                            kKerasAlignment * kKerasAlignment,
+                        '\0');
+    }
+    record_->append((const char*)data, n);
+}
+
+bool KerasReader::ReadUnsignedInt(unsigned int* i) {
     KASSERT(i, "Invalid pointer");
+    KASSERT(size_ - offset_ >= sizeof(unsigned int), "Expected unsigned int");
 
-    file->read((char*)i, sizeof(unsigned int));
-    KASSERT(file->gcount() == sizeof(unsigned int), "Expected unsigned int");
+    memcpy(i, data_ + offset_, sizeof(unsigned int));
+    offset_ += sizeof(unsigned int);
+    Write(i, sizeof(unsigned int), false);
 
     return true;
 }
 
-bool ReadFloat(std::istream* file, float* f) {
-    KASSERT(file, "Invalid file stream");
+bool KerasReader::ReadFloat(float* f) {
     KASSERT(f, "Invalid pointer");
+    KASSERT(size_ - offset_ >= sizeof(float), "Expected float");
 
-    file->read((char*)f, sizeof(float));
-    KASSERT(file->gcount() == sizeof(float), "Expected float");
+    memcpy(f, data_ + offset_, sizeof(float));
+    offset_ += sizeof(float);
+    Write(f, sizeof(float), false);
 
     return true;
 }
 
-bool ReadFloats(std::istream* file, float* f, size_t n) {
-    KASSERT(file, "Invalid file stream");
-    KASSERT(f, "Invalid pointer");
+bool KerasReader::ReadTensor(Tensor* t, int i) {
+    t->dims_ = {i};
+    return ReadTensorData(t);
+}
+
+bool KerasReader::ReadTensor(Tensor* t, int i, int j) {
+    t->dims_ = {i, j};
+    return ReadTensorData(t);
+}
+
+bool KerasReader::ReadTensor(Tensor* t, int i, int j, int k) {
+    t->dims_ = {i, j, k};
+    return ReadTensorData(t);
+}
+
+bool KerasReader::ReadTensor(Tensor* t, int i, int j, int k, int l) {
+    t->dims_ = {i, j, k, l};
+    return ReadTensorData(t);
+}
 
-    file->read((char*)f, sizeof(float) * n);
-    KASSERT(((unsigned int)file->gcount()) == sizeof(float) * n,
-            "Expected floats");
+bool KerasReader::ReadTensorData(Tensor* t) {
+    KASSERT(t, "Invalid tensor");
+
+    size_t n = 1;
+    for (size_t d = 0; d < t->dims_.size(); d++) {
+        n *= t->dims_[d];
+    }
+
+    KASSERT(Align(), "Failed to align tensor");
+    KASSERT((size_ - offset_) / sizeof(float) >= n, "Expected floats");
+
+    const char* data = data_ + offset_;
+    if (aligned_) {
+        t->View((const float*)data);
+    } else {
+        t->data_.resize(n);
+        t->view_ = NULL;
+        memcpy(t->data_.data(), data, n * sizeof(float));
+    }
+    offset_ += n * sizeof(float);
+    Write(data, n * sizeof(float), true);
 
     return true;
 }
 
-bool KerasLayerActivation::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerActivation::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
     unsigned int activation = 0;
-    KASSERT(ReadUnsignedInt(file, &activation),
+    KASSERT(reader->ReadUnsignedInt(&activation),
             "Failed to read activation type");
 
     switch (activation) {
@@ -77,96 +144,97 @@ bool KerasLayerActivation::LoadLayer(std::istream* file) {
     return true;
 }
 
-bool KerasLayerActivation::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerActivation::Apply(const Tensor* in, Tensor* out,
+                                 KerasContext* /* ctx */) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
 
     *out = *in;
+    ApplyInPlace(out->data_.data(), out->data_.size());
 
+    return true;
+}
+
+void KerasLayerActivation::ApplyInPlace(float* data, size_t n) const {
     switch (activation_type_) {
     case kLinear:
         break;
     case kRelu:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            if (out->data_[i] < 0.0) {
-                out->data_[i] = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            if (data[i] < 0.0) {
+                data[i] = 0.0;
             }
         }
         break;
     case kSoftPlus:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            out->data_[i] = std::log(1.0 + std::exp(out->data_[i]));
+        for (size_t i = 0; i < n; i++) {
+            data[i] = std::log(1.0 + std::exp(data[i]));
         }
         break;
     case kHardSigmoid:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            float x = (out->data_[i] * 0.2) + 0.5;
+        for (size_t i = 0; i < n; i++) {
+            float x = (data[i] * 0.2) + 0.5;
 
             if (x <= 0) {
-                out->data_[i] = 0.0;
+                data[i] = 0.0;
             } else if (x >= 1) {
-                out->data_[i] = 1.0;
+                data[i] = 1.0;
             } else {
-                out->data_[i] = x;
+                data[i] = x;
             }
         }
         break;
     case kSigmoid:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            float& x = out->data_[i];
+        for (size_t i = 0; i < n; i++) {
+            float& x = data[i];
 
             if (x >= 0) {
-                out->data_[i] = 1.0 / (1.0 + std::exp(-x));
+                data[i] = 1.0 / (1.0 + std::exp(-x));
             } else {
                 float z = std::exp(x);
-                out->data_[i] = z / (1.0 + z);
+                data[i] = z / (1.0 + z);
             }
         }
         break;
     case kTanh:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            out->data_[i] = std::tanh(out->data_[i]);
+        for (size_t i = 0; i < n; i++) {
+            data[i] = std::tanh(data[i]);
         }
         break;
     default:
         break;
     }
-
-    return true;
 }
 
-bool KerasLayerDense::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerDense::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
     unsigned int weights_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_rows), "Expected weight rows");
+    KASSERT(reader->ReadUnsignedInt(&weights_rows), "Expected weight rows");
     KASSERT(weights_rows > 0, "Invalid weights # rows");
 
     unsigned int weights_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_cols), "Expected weight cols");
+    KASSERT(reader->ReadUnsignedInt(&weights_cols), "Expected weight cols");
     KASSERT(weights_cols > 0, "Invalid weights shape");
 
     unsigned int biases_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &biases_shape), "Expected biases shape");
+    KASSERT(reader->ReadUnsignedInt(&biases_shape), "Expected biases shape");
     KASSERT(biases_shape > 0, "Invalid biases shape");
 
-    weights_.Resize(weights_rows, weights_cols);
-    KASSERT(
-        ReadFloats(file, weights_.data_.data(), weights_rows * weights_cols),
-        "Expected weights");
+    KASSERT(reader->ReadTensor(&weights_, weights_rows, weights_cols), "Expected weights");
 
-    biases_.Resize(biases_shape);
-    KASSERT(ReadFloats(file, biases_.data_.data(), biases_shape),
-            "Expected biases");
+    KASSERT(reader->ReadTensor(&biases_, biases_shape), "Expected biases");
 
-    KASSERT(activation_.LoadLayer(file), "Failed to load activation");
+    KASSERT(activation_.LoadLayer(reader), "Failed to load activation");
 
     return true;
 }
 
-bool KerasLayerDense::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerDense::Apply(const Tensor* in, Tensor* out,
+                            KerasContext* ctx) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
+    KASSERT(ctx, "Invalid context");
     KASSERT(in->dims_.size() <= 2, "Invalid input dimensions");
 
     if (in->dims_.size() == 2) {
@@ -174,90 +242,263 @@ bool KerasLayerDense::Apply(Tensor* in, Tensor* out) {
                 in->dims_[1], weights_.dims_[0]);
     }
 
-    Tensor tmp(weights_.dims_[1]);
+    const int rows = weights_.dims_[0];
+    const int cols = weights_.dims_[1];
+    out->Resize(cols);
+
+    if (quantized_) {
+        KASSERT(ApplyQuantized(in, out, ctx),
+                "Failed to apply quantized layer");
+    } else {
+        KASSERT((int)in->data_.size() == rows, "Dimension mismatch %d %d",
+                (int)in->data_.size(), rows);
+
+        float* tmp = out->data_.data();
+        std::fill(tmp, tmp + cols, 0.0f);
+        for (int i = 0; i < rows; i++) {
+            const float x = in->data_[i];
+            const float* w = weights_.Data() + (size_t)i * cols;
+            for (int j = 0; j < cols; j++) {
+                tmp[j] += x * w[j];
+            }
+        }
+
+        for (int i = 0; i < biases_.dims_[0]; i++) {
+            tmp[i] += biases_.Data()[i];
+        }
+    }
+
+    activation_.ApplyInPlace(out->data_.data(), out->data_.size());
+
+    return true;
+}
+
+bool KerasLayerDense::Quantize() {
+    if (quantized_) {
+        return true;
+    }
 
-    for (int i = 0; i < weights_.dims_[0]; i++) {
-        for (int j = 0; j < weights_.dims_[1]; j++) {
-            tmp(j) += (*in)(i)*weights_(i, j);
+    const int rows = weights_.dims_[0];
+    const int cols = weights_.dims_[1];
+    // Small layers (e.g. a single output neuron) do not cost bandwidth, but
+    // lose the most accuracy since their scale covers all weights.
+    if (rows * cols < kQuantizedBlock * kQuantizedBlock) {
+        return true;
+    }
+    quantized_rows_ =
+        (rows + kQuantizedBlock - 1) / kQuantizedBlock * kQuantizedBlock;
+    quantized_weights_.assign((size_t)cols * quantized_rows_, 0);
+    quantized_scales_.resize(cols);
+    quantized_sums_.resize(cols);
+
+    const Tensor& weights = weights_;
+    for (int j = 0; j < cols; j++) {
+        float max_abs = 0.0f;
+        for (int i = 0; i < rows; i++) {
+            max_abs = std::max(max_abs, std::fabs(weights(i, j)));
+        }
+        const float scale = (max_abs > 0.0f) ? max_abs / 127.0f : 1.0f;
+
+        int32_t sum = 0;
+        int8_t* row = quantized_weights_.data() + (size_t)j * quantized_rows_;
+        for (int i = 0; i < rows; i++) {
+            long q = lrintf(weights(i, j) / scale);
+            q = std::min(127L, std::max(-127L, q));
+            row[i] = (int8_t)q;
+            sum += q;
         }
+        quantized_scales_[j] = scale;
+        quantized_sums_[j] = sum;
     }
 
-    for (int i = 0; i < biases_.dims_[0]; i++) {
-        tmp(i) += biases_(i);
+    // Keep only the shape, the float weights are not used anymore.
+    std::vector<float>().swap(weights_.data_);
+    weights_.view_ = NULL;
+    quantized_ = true;
+
+    return true;
+}
+
+// Returns sum(a[i] * b[i]) over n bytes, n is a multiple of kQuantizedBlock.
+// a has to be in [0, 127] so that the pairwise sums of maddubs can not
+// saturate.
+static inline int32_t DotU8S8(const uint8_t* a, const int8_t* b, int n) {
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    __m256i acc = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        acc = _mm256_dpbusd_epi32(acc, va, vb);
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i pairs = _mm256_maddubs_epi16(va, vb);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__SSSE3__)
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i pairs = _mm_maddubs_epi16(va, vb);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(pairs, ones));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return sum;
+#endif
+}
+
+bool KerasLayerDense::ApplyQuantized(const Tensor* in, Tensor* out,
+                                     KerasContext* ctx) const {
+    const int rows = weights_.dims_[0];
+    const int cols = weights_.dims_[1];
+    KASSERT((int)in->data_.size() == rows, "Dimension mismatch %d %d",
+            (int)in->data_.size(), rows);
+
+    // Non-negative inputs (e.g. after a relu) use all 7 bits, otherwise the
+    // inputs are shifted by an offset of 64.
+    float min_val = 0.0f;
+    float max_val = 0.0f;
+    for (int i = 0; i < rows; i++) {
+        min_val = std::min(min_val, in->data_[i]);
+        max_val = std::max(max_val, in->data_[i]);
+    }
+    int32_t offset = 0;
+    float scale = max_val / 127.0f;
+    if (min_val < 0.0f) {
+        offset = 64;
+        scale = std::max(-min_val, max_val) / 63.0f;
+    }
+    if (scale == 0.0f) {
+        scale = 1.0f;
     }
 
-    KASSERT(activation_.Apply(&tmp, out), "Failed to apply activation");
+    uint8_t* quantized_in = ctx->ByteWorkspace(quantized_rows_);
+    std::fill(quantized_in + rows, quantized_in + quantized_rows_, 0);
+    const float inv_scale = 1.0f / scale;
+    for (int i = 0; i < rows; i++) {
+        long q = lrintf(in->data_[i] * inv_scale) + offset;
+        quantized_in[i] = (uint8_t)std::min(127L, std::max(0L, q));
+    }
+
+    for (int j = 0; j < cols; j++) {
+        const int8_t* row =
+            quantized_weights_.data() + (size_t)j * quantized_rows_;
+        int32_t acc = DotU8S8(quantized_in, row, quantized_rows_);
+        acc -= offset * quantized_sums_[j];
+        out->data_[j] = acc * scale * quantized_scales_[j] + biases_.Data()[j];
+    }
 
     return true;
 }
 
-bool KerasLayerConvolution2d::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerConvolution2d::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
     unsigned int weights_i = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_i), "Expected weights_i");
+    KASSERT(reader->ReadUnsignedInt(&weights_i), "Expected weights_i");
     KASSERT(weights_i > 0, "Invalid weights # i");
 
     unsigned int weights_j = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_j), "Expected weights_j");
+    KASSERT(reader->ReadUnsignedInt(&weights_j), "Expected weights_j");
     KASSERT(weights_j > 0, "Invalid weights # j");
 
     unsigned int weights_k = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_k), "Expected weights_k");
+    KASSERT(reader->ReadUnsignedInt(&weights_k), "Expected weights_k");
     KASSERT(weights_k > 0, "Invalid weights # k");
 
     unsigned int weights_l = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_l), "Expected weights_l");
+    KASSERT(reader->ReadUnsignedInt(&weights_l), "Expected weights_l");
     KASSERT(weights_l > 0, "Invalid weights # l");
 
     unsigned int biases_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &biases_shape), "Expected biases shape");
+    KASSERT(reader->ReadUnsignedInt(&biases_shape), "Expected biases shape");
     KASSERT(biases_shape > 0, "Invalid biases shape");
 
-    weights_.Resize(weights_i, weights_j, weights_k, weights_l);
-    KASSERT(ReadFloats(file, weights_.data_.data(),
-                       weights_i * weights_j * weights_k * weights_l),
-            "Expected weights");
+    KASSERT(reader->ReadTensor(&weights_, weights_i, weights_j, weights_k, weights_l), "Expected weights");
 
-    biases_.Resize(biases_shape);
-    KASSERT(ReadFloats(file, biases_.data_.data(), biases_shape),
-            "Expected biases");
+    KASSERT(reader->ReadTensor(&biases_, biases_shape), "Expected biases");
 
-    KASSERT(activation_.LoadLayer(file), "Failed to load activation");
+    KASSERT(activation_.LoadLayer(reader), "Failed to load activation");
 
     return true;
 }
 
-bool KerasLayerConvolution2d::Apply(Tensor* in, Tensor* out) {
+// Number of output rows that are computed together, so that the output block
+// stays in the L1 cache while all kernel taps are added.
+static const int kConvolutionBlockFloats = 2048;
+
+bool KerasLayerConvolution2d::Apply(const Tensor* in, Tensor* out,
+                                    KerasContext* /* ctx */) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
+    KASSERT(in->dims_.size() == 3, "Input must have 3 dimensions");
 
     KASSERT(in->dims_[0] == weights_.dims_[1],
             "Input 'depth' doesn't match kernel 'depth'");
 
-    int st_nj = (weights_.dims_[2] - 1) / 2;
-    int st_pj = (weights_.dims_[2]) / 2;
-    int st_nk = (weights_.dims_[3] - 1) / 2;
-    int st_pk = (weights_.dims_[3]) / 2;
-
-    Tensor tmp(weights_.dims_[0], in->dims_[1] - st_nj - st_pj,
-               in->dims_[2] - st_nk - st_pk);
-
-    // Iterate over each kernel.
-    for (int i = 0; i < weights_.dims_[0]; i++) {
-        // Iterate over each 'depth'.
-        for (int j = 0; j < weights_.dims_[1]; j++) {
-            // 2D convolution in x and y (k and l in Tensor dimensions).
-            for (int tj = st_nj; tj < in->dims_[1] - st_pj; tj++) {
-                for (int tk = st_nk; tk < in->dims_[2] - st_pk; tk++) {
-                    // Iterate over kernel.
-                    for (int k = 0; k < weights_.dims_[2]; k++) {
-                        for (int l = 0; l < weights_.dims_[3]; l++) {
-                            const float& weight = weights_(i, j, k, l);
-                            const float& value =
-                                (*in)(j, tj - st_nj + k, tk - st_nk + l);
-
-                            tmp(i, tj - st_nj, tk - st_nk) += weight * value;
+    const int kernels = weights_.dims_[0];
+    const int depth = weights_.dims_[1];
+    const int kernel_rows = weights_.dims_[2];
+    const int kernel_cols = weights_.dims_[3];
+    const int in_rows = in->dims_[1];
+    const int in_cols = in->dims_[2];
+    const int out_rows = in_rows - kernel_rows + 1;
+    const int out_cols = in_cols - kernel_cols + 1;
+    KASSERT(out_rows > 0 && out_cols > 0, "Input smaller than kernel");
+
+    out->Resize(kernels, out_rows, out_cols);
+
+    // Direct convolution on the row major (depth x rows x cols) layout: each
+    // kernel tap is a scaled add of a contiguous input row to an output row.
+    // Every output point sums over depth, kernel row and kernel col in the
+    // same order as the naive loop.
+    const int block_rows = std::max(1, kConvolutionBlockFloats / out_cols);
+    const float* input = in->data_.data();
+    for (int i = 0; i < kernels; i++) {
+        float* output = out->data_.data() + (size_t)i * out_rows * out_cols;
+        std::fill(output, output + (size_t)out_rows * out_cols, 0.0f);
+
+        for (int r0 = 0; r0 < out_rows; r0 += block_rows) {
+            const int r1 = std::min(out_rows, r0 + block_rows);
+            for (int j = 0; j < depth; j++) {
+                const float* channel = input + (size_t)j * in_rows * in_cols;
+                const float* w = weights_.Data() +
+                                 ((size_t)i * depth + j) * kernel_rows *
+                                     kernel_cols;
+                for (int k = 0; k < kernel_rows; k++) {
+                    for (int l = 0; l < kernel_cols; l++) {
+                        const float weight = w[k * kernel_cols + l];
+                        for (int r = r0; r < r1; r++) {
+                            const float* __restrict__ src =
+                                channel + (size_t)(r + k) * in_cols + l;
+                            float* __restrict__ dst =
+                                output + (size_t)r * out_cols;
+                            for (int c = 0; c < out_cols; c++) {
+                                dst[c] += weight * src[c];
+                            }
                         }
                     }
                 }
@@ -265,24 +506,93 @@ bool KerasLayerConvolution2d::Apply(Tensor* in, Tensor* out) {
         }
 
         // Apply kernel bias to all points in output.
-        for (int j = 0; j < tmp.dims_[1]; j++) {
-            for (int k = 0; k < tmp.dims_[2]; k++) {
-                tmp(i, j, k) += biases_(i);
+        const float bias = biases_.Data()[i];
+        for (size_t p = 0; p < (size_t)out_rows * out_cols; p++) {
+            output[p] += bias;
+        }
+    }
+
+    activation_.ApplyInPlace(out->data_.data(), out->data_.size());
+
+    return true;
+}
+
+bool KerasLayerConvolution1d::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
+
+    unsigned int kernel_size = 0;
+    KASSERT(reader->ReadUnsignedInt(&kernel_size), "Expected kernel size");
+    KASSERT(kernel_size > 0, "Invalid kernel size");
+
+    unsigned int channels = 0;
+    KASSERT(reader->ReadUnsignedInt(&channels), "Expected channels");
+    KASSERT(channels > 0, "Invalid channels");
+
+    unsigned int filters = 0;
+    KASSERT(reader->ReadUnsignedInt(&filters), "Expected filters");
+    KASSERT(filters > 0, "Invalid filters");
+
+    unsigned int biases_shape = 0;
+    KASSERT(reader->ReadUnsignedInt(&biases_shape), "Expected biases shape");
+    KASSERT(biases_shape == filters, "Invalid biases shape");
+
+    KASSERT(reader->ReadTensor(&weights_, kernel_size, channels, filters), "Expected weights");
+
+    KASSERT(reader->ReadTensor(&biases_, biases_shape), "Expected biases");
+
+    KASSERT(activation_.LoadLayer(reader), "Failed to load activation");
+
+    return true;
+}
+
+bool KerasLayerConvolution1d::Apply(const Tensor* in, Tensor* out,
+                                    KerasContext* /* ctx */) const {
+    KASSERT(in, "Invalid input");
+    KASSERT(out, "Invalid output");
+    KASSERT(in->dims_.size() == 2, "Input must have 2 dimensions");
+
+    const int kernel_size = weights_.dims_[0];
+    const int channels = weights_.dims_[1];
+    const int filters = weights_.dims_[2];
+    KASSERT(in->dims_[1] == channels, "Dimension mismatch %d %d",
+            in->dims_[1], channels);
+    const int steps = in->dims_[0] - kernel_size + 1;
+    KASSERT(steps > 0, "Input shorter than kernel");
+
+    out->Resize(steps, filters);
+
+    // The window of kernel_size rows is contiguous in the input, the
+    // filters are contiguous in the weights.
+    const int window = kernel_size * channels;
+    for (int t = 0; t < steps; t++) {
+        const float* x = in->data_.data() + (size_t)t * channels;
+        float* __restrict__ o = out->data_.data() + (size_t)t * filters;
+        std::fill(o, o + filters, 0.0f);
+        for (int i = 0; i < window; i++) {
+            const float value = x[i];
+            const float* __restrict__ w =
+                weights_.Data() + (size_t)i * filters;
+            for (int f = 0; f < filters; f++) {
+                o[f] += value * w[f];
             }
         }
+        for (int f = 0; f < filters; f++) {
+            o[f] += biases_.Data()[f];
+        }
     }
 
-    KASSERT(activation_.Apply(&tmp, out), "Failed to apply activation");
+    activation_.ApplyInPlace(out->data_.data(), out->data_.size());
 
     return true;
 }
 
-bool KerasLayerFlatten::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerFlatten::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
     return true;
 }
 
-bool KerasLayerFlatten::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerFlatten::Apply(const Tensor* in, Tensor* out,
+                              KerasContext* /* ctx */) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
 
@@ -292,15 +602,16 @@ bool KerasLayerFlatten::Apply(Tensor* in, Tensor* out) {
     return true;
 }
 
-bool KerasLayerElu::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerElu::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
-    KASSERT(ReadFloat(file, &alpha_), "Failed to read alpha");
+    KASSERT(reader->ReadFloat(&alpha_), "Failed to read alpha");
 
     return true;
 }
 
-bool KerasLayerElu::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerElu::Apply(const Tensor* in, Tensor* out,
+                          KerasContext* /* ctx */) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
 
@@ -315,310 +626,461 @@ bool KerasLayerElu::Apply(Tensor* in, Tensor* out) {
     return true;
 }
 
-bool KerasLayerMaxPooling2d::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerMaxPooling2d::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
-    KASSERT(ReadUnsignedInt(file, &pool_size_j_), "Expected pool size j");
-    KASSERT(ReadUnsignedInt(file, &pool_size_k_), "Expected pool size k");
+    KASSERT(reader->ReadUnsignedInt(&pool_size_j_), "Expected pool size j");
+    KASSERT(reader->ReadUnsignedInt(&pool_size_k_), "Expected pool size k");
 
     return true;
 }
 
-bool KerasLayerMaxPooling2d::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerMaxPooling2d::Apply(const Tensor* in, Tensor* out,
+                                   KerasContext* /* ctx */) const {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
 
     KASSERT(in->dims_.size() == 3, "Input must have 3 dimensions");
 
-    Tensor tmp(in->dims_[0], in->dims_[1] / pool_size_j_,
-               in->dims_[2] / pool_size_k_);
-
-    for (int i = 0; i < tmp.dims_[0]; i++) {
-        for (int j = 0; j < tmp.dims_[1]; j++) {
-            const int tj = j * pool_size_j_;
-
-            for (int k = 0; k < tmp.dims_[2]; k++) {
-                const int tk = k * pool_size_k_;
-
-                // Find maximum value over patch starting at tj, tk.
-                float max_val = -std::numeric_limits<float>::infinity();
-
-                for (unsigned int pj = 0; pj < pool_size_j_; pj++) {
-                    for (unsigned int pk = 0; pk < pool_size_k_; pk++) {
-                        const float& pool_val = (*in)(i, tj + pj, tk + pk);
-                        if (pool_val > max_val) {
-                            max_val = pool_val;
-                        }
+    const int channels = in->dims_[0];
+    const int in_rows = in->dims_[1];
+    const int in_cols = in->dims_[2];
+    const int out_rows = in_rows / pool_size_j_;
+    const int out_cols = in_cols / pool_size_k_;
+    out->Resize(channels, out_rows, out_cols);
+
+    // Row wise: every input row of a patch is folded into the output row.
+    for (int i = 0; i < channels; i++) {
+        for (int j = 0; j < out_rows; j++) {
+            float* __restrict__ dst =
+                out->data_.data() + ((size_t)i * out_rows + j) * out_cols;
+            std::fill(dst, dst + out_cols,
+                      -std::numeric_limits<float>::infinity());
+
+            for (unsigned int pj = 0; pj < pool_size_j_; pj++) {
+                const float* __restrict__ src =
+                    in->data_.data() +
+                    ((size_t)i * in_rows + j * pool_size_j_ + pj) * in_cols;
+                for (unsigned int pk = 0; pk < pool_size_k_; pk++) {
+                    for (int k = 0; k < out_cols; k++) {
+                        const float pool_val = src[k * pool_size_k_ + pk];
+                        dst[k] = (pool_val > dst[k]) ? pool_val : dst[k];
                     }
                 }
-
-                tmp(i, j, k) = max_val;
             }
         }
     }
 
-    *out = tmp;
-
     return true;
 }
 
-bool KerasLayerLSTM::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerLSTM::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
     unsigned int wi_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &wi_rows), "Expected Wi rows");
+    KASSERT(reader->ReadUnsignedInt(&wi_rows), "Expected Wi rows");
     KASSERT(wi_rows > 0, "Invalid Wi # rows");
 
     unsigned int wi_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &wi_cols), "Expected Wi cols");
+    KASSERT(reader->ReadUnsignedInt(&wi_cols), "Expected Wi cols");
     KASSERT(wi_cols > 0, "Invalid Wi shape");
 
     unsigned int ui_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &ui_rows), "Expected Ui rows");
+    KASSERT(reader->ReadUnsignedInt(&ui_rows), "Expected Ui rows");
     KASSERT(ui_rows > 0, "Invalid Ui # rows");
 
     unsigned int ui_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &ui_cols), "Expected Ui cols");
+    KASSERT(reader->ReadUnsignedInt(&ui_cols), "Expected Ui cols");
     KASSERT(ui_cols > 0, "Invalid Ui shape");
 
     unsigned int bi_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &bi_shape), "Expected bi shape");
+    KASSERT(reader->ReadUnsignedInt(&bi_shape), "Expected bi shape");
     KASSERT(bi_shape > 0, "Invalid bi shape");
 
     unsigned int wf_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &wf_rows), "Expected Wf rows");
+    KASSERT(reader->ReadUnsignedInt(&wf_rows), "Expected Wf rows");
     KASSERT(wf_rows > 0, "Invalid Wf # rows");
 
     unsigned int wf_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &wf_cols), "Expected Wf cols");
+    KASSERT(reader->ReadUnsignedInt(&wf_cols), "Expected Wf cols");
     KASSERT(wf_cols > 0, "Invalid Wf shape");
 
     unsigned int uf_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &uf_rows), "Expected Uf rows");
+    KASSERT(reader->ReadUnsignedInt(&uf_rows), "Expected Uf rows");
     KASSERT(uf_rows > 0, "Invalid Uf # rows");
 
     unsigned int uf_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &uf_cols), "Expected Uf cols");
+    KASSERT(reader->ReadUnsignedInt(&uf_cols), "Expected Uf cols");
     KASSERT(uf_cols > 0, "Invalid Uf shape");
 
     unsigned int bf_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &bf_shape), "Expected bf shape");
+    KASSERT(reader->ReadUnsignedInt(&bf_shape), "Expected bf shape");
     KASSERT(bf_shape > 0, "Invalid bf shape");
 
     unsigned int wc_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &wc_rows), "Expected Wc rows");
+    KASSERT(reader->ReadUnsignedInt(&wc_rows), "Expected Wc rows");
     KASSERT(wc_rows > 0, "Invalid Wc # rows");
 
     unsigned int wc_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &wc_cols), "Expected Wc cols");
+    KASSERT(reader->ReadUnsignedInt(&wc_cols), "Expected Wc cols");
     KASSERT(wc_cols > 0, "Invalid Wc shape");
 
     unsigned int uc_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &uc_rows), "Expected Uc rows");
+    KASSERT(reader->ReadUnsignedInt(&uc_rows), "Expected Uc rows");
     KASSERT(uc_rows > 0, "Invalid Uc # rows");
 
     unsigned int uc_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &uc_cols), "Expected Uc cols");
+    KASSERT(reader->ReadUnsignedInt(&uc_cols), "Expected Uc cols");
     KASSERT(uc_cols > 0, "Invalid Uc shape");
 
     unsigned int bc_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &bc_shape), "Expected bc shape");
+    KASSERT(reader->ReadUnsignedInt(&bc_shape), "Expected bc shape");
     KASSERT(bc_shape > 0, "Invalid bc shape");
 
     unsigned int wo_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &wo_rows), "Expected Wo rows");
+    KASSERT(reader->ReadUnsignedInt(&wo_rows), "Expected Wo rows");
     KASSERT(wo_rows > 0, "Invalid Wo # rows");
 
     unsigned int wo_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &wo_cols), "Expected Wo cols");
+    KASSERT(reader->ReadUnsignedInt(&wo_cols), "Expected Wo cols");
     KASSERT(wo_cols > 0, "Invalid Wo shape");
 
     unsigned int uo_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &uo_rows), "Expected Uo rows");
+    KASSERT(reader->ReadUnsignedInt(&uo_rows), "Expected Uo rows");
     KASSERT(uo_rows > 0, "Invalid Uo # rows");
 
     unsigned int uo_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &uo_cols), "Expected Uo cols");
+    KASSERT(reader->ReadUnsignedInt(&uo_cols), "Expected Uo cols");
     KASSERT(uo_cols > 0, "Invalid Uo shape");
 
     unsigned int bo_shape = 0;
-    KASSERT(ReadUnsignedInt(file, &bo_shape), "Expected bo shape");
+    KASSERT(reader->ReadUnsignedInt(&bo_shape), "Expected bo shape");
     KASSERT(bo_shape > 0, "Invalid bo shape");
 
     // Load Input Weights and Biases
-    Wi_.Resize(wi_rows, wi_cols);
-    KASSERT(ReadFloats(file, Wi_.data_.data(), wi_rows * wi_cols),
-            "Expected Wi weights");
+    KASSERT(reader->ReadTensor(&Wi_, wi_rows, wi_cols), "Expected Wi weights");
 
-    Ui_.Resize(ui_rows, ui_cols);
-    KASSERT(ReadFloats(file, Ui_.data_.data(), ui_rows * ui_cols),
-            "Expected Ui weights");
+    KASSERT(reader->ReadTensor(&Ui_, ui_rows, ui_cols), "Expected Ui weights");
 
-    bi_.Resize(1, bi_shape);
-    KASSERT(ReadFloats(file, bi_.data_.data(), bi_shape), "Expected bi biases");
+    KASSERT(reader->ReadTensor(&bi_, 1, bi_shape), "Expected bi biases");
 
     // Load Forget Weights and Biases
-    Wf_.Resize(wf_rows, wf_cols);
-    KASSERT(ReadFloats(file, Wf_.data_.data(), wf_rows * wf_cols),
-            "Expected Wf weights");
+    KASSERT(reader->ReadTensor(&Wf_, wf_rows, wf_cols), "Expected Wf weights");
 
-    Uf_.Resize(uf_rows, uf_cols);
-    KASSERT(ReadFloats(file, Uf_.data_.data(), uf_rows * uf_cols),
-            "Expected Uf weights");
+    KASSERT(reader->ReadTensor(&Uf_, uf_rows, uf_cols), "Expected Uf weights");
 
-    bf_.Resize(1, bf_shape);
-    KASSERT(ReadFloats(file, bf_.data_.data(), bf_shape), "Expected bf biases");
+    KASSERT(reader->ReadTensor(&bf_, 1, bf_shape), "Expected bf biases");
 
     // Load State Weights and Biases
-    Wc_.Resize(wc_rows, wc_cols);
-    KASSERT(ReadFloats(file, Wc_.data_.data(), wc_rows * wc_cols),
-            "Expected Wc weights");
+    KASSERT(reader->ReadTensor(&Wc_, wc_rows, wc_cols), "Expected Wc weights");
 
-    Uc_.Resize(uc_rows, uc_cols);
-    KASSERT(ReadFloats(file, Uc_.data_.data(), uc_rows * uc_cols),
-            "Expected Uc weights");
+    KASSERT(reader->ReadTensor(&Uc_, uc_rows, uc_cols), "Expected Uc weights");
 
-    bc_.Resize(1, bc_shape);
-    KASSERT(ReadFloats(file, bc_.data_.data(), bc_shape), "Expected bc biases");
+    KASSERT(reader->ReadTensor(&bc_, 1, bc_shape), "Expected bc biases");
 
     // Load Output Weights and Biases
-    Wo_.Resize(wo_rows, wo_cols);
-    KASSERT(ReadFloats(file, Wo_.data_.data(), wo_rows * wo_cols),
-            "Expected Wo weights");
+    KASSERT(reader->ReadTensor(&Wo_, wo_rows, wo_cols), "Expected Wo weights");
 
-    Uo_.Resize(uo_rows, uo_cols);
-    KASSERT(ReadFloats(file, Uo_.data_.data(), uo_rows * uo_cols),
-            "Expected Uo weights");
+    KASSERT(reader->ReadTensor(&Uo_, uo_rows, uo_cols), "Expected Uo weights");
 
-    bo_.Resize(1, bo_shape);
-    KASSERT(ReadFloats(file, bo_.data_.data(), bo_shape), "Expected bo biases");
+    KASSERT(reader->ReadTensor(&bo_, 1, bo_shape), "Expected bo biases");
 
-    KASSERT(innerActivation_.LoadLayer(file),
+    KASSERT(innerActivation_.LoadLayer(reader),
             "Failed to load inner activation");
-    KASSERT(activation_.LoadLayer(file), "Failed to load activation");
+    KASSERT(activation_.LoadLayer(reader), "Failed to load activation");
 
     unsigned int return_sequences = 0;
-    KASSERT(ReadUnsignedInt(file, &return_sequences),
+    KASSERT(reader->ReadUnsignedInt(&return_sequences),
             "Expected return_sequences param");
     return_sequences_ = (bool)return_sequences;
 
+    KASSERT(FuseGates(), "Failed to fuse gates");
+
     return true;
 }
 
-bool KerasLayerLSTM::Apply(Tensor* in, Tensor* out) {
-    // Assume bo always keeps the output shape and we will always receive one
-    // single sample.
-    int outputDim = bo_.dims_[1];
-    Tensor ht_1 = Tensor(1, outputDim);
-    Tensor ct_1 = Tensor(1, outputDim);
+bool KerasLayerLSTM::FuseGates() {
+    input_dim_ = Wi_.dims_[0];
+    output_dim_ = bo_.dims_[1];
+
+    Tensor* W[4] = {&Wi_, &Wf_, &Wc_, &Wo_};
+    Tensor* U[4] = {&Ui_, &Uf_, &Uc_, &Uo_};
+    Tensor* b[4] = {&bi_, &bf_, &bc_, &bo_};
+    for (int g = 0; g < 4; g++) {
+        KASSERT(W[g]->dims_[0] == input_dim_ &&
+                    W[g]->dims_[1] == output_dim_,
+                "Invalid W shape of gate %d", g);
+        KASSERT(U[g]->dims_[0] == output_dim_ &&
+                    U[g]->dims_[1] == output_dim_,
+                "Invalid U shape of gate %d", g);
+        KASSERT(b[g]->dims_[1] == output_dim_, "Invalid b shape of gate %d",
+                g);
+    }
+
+    const int fused = 4 * output_dim_;
+    W_.Resize(input_dim_, fused);
+    U_.Resize(output_dim_, fused);
+    b_.Resize(fused);
+    for (int g = 0; g < 4; g++) {
+        for (int k = 0; k < input_dim_; k++) {
+            std::copy(W[g]->Data() + (size_t)k * output_dim_,
+                      W[g]->Data() + (size_t)(k + 1) * output_dim_,
+                      W_.data_.begin() + (size_t)k * fused + g * output_dim_);
+        }
+        for (int k = 0; k < output_dim_; k++) {
+            std::copy(U[g]->Data() + (size_t)k * output_dim_,
+                      U[g]->Data() + (size_t)(k + 1) * output_dim_,
+                      U_.data_.begin() + (size_t)k * fused + g * output_dim_);
+        }
+        std::copy(b[g]->Data(), b[g]->Data() + output_dim_,
+                  b_.data_.begin() + g * output_dim_);
 
-    ht_1.Fill(0.0f);
-    ct_1.Fill(0.0f);
+        *W[g] = Tensor();
+        *U[g] = Tensor();
+        *b[g] = Tensor();
+    }
 
-    int steps = in->dims_[0];
+    return true;
+}
 
-    Tensor outputs, lastOutput;
+bool KerasLayerLSTM::Apply(const Tensor* in, Tensor* out,
+                           KerasContext* ctx) const {
+    KASSERT(in, "Invalid input");
+    KASSERT(out, "Invalid output");
+    KASSERT(ctx, "Invalid context");
+    KASSERT(in->dims_.size() == 2, "Input must have 2 dimensions");
+    KASSERT(in->dims_[1] == input_dim_, "Dimension mismatch %d %d",
+            in->dims_[1], input_dim_);
+
+    // We will always receive one single sample.
+    const int outputDim = output_dim_;
+    const int inputDim = input_dim_;
+    const int steps = in->dims_[0];
+
+    // hidden state, cell state, the four gates and scratch for Step
+    float* ht = ctx->Workspace(10 * outputDim);
+    float* ct = ht + outputDim;
+    float* gates = ct + outputDim;
+    std::fill(ht, ht + 2 * outputDim, 0.0f);
 
     if (return_sequences_) {
-        outputs.dims_ = {steps, outputDim};
-        outputs.data_.reserve(steps * outputDim);
+        out->Resize(steps, outputDim);
+    } else {
+        out->Resize(1, outputDim);
     }
 
     for (int s = 0; s < steps; s++) {
-        Tensor x = in->Select(s);
+        const float* x = in->data_.data() + (size_t)s * inputDim;
 
-        KASSERT(Step(&x, &lastOutput, &ht_1, &ct_1), "Failed to execute step");
+        KASSERT(Step(x, ht, ct, gates), "Failed to execute step");
 
         if (return_sequences_) {
-            outputs.data_.insert(outputs.data_.end(), lastOutput.data_.begin(),
-                                 lastOutput.data_.end());
+            std::copy(ht, ht + outputDim,
+                      out->data_.begin() + (size_t)s * outputDim);
         }
     }
 
-    if (return_sequences_) {
-        *out = outputs;
-    } else {
-        *out = lastOutput;
+    if (!return_sequences_) {
+        std::copy(ht, ht + outputDim, out->data_.begin());
     }
 
     return true;
 }
 
-bool KerasLayerEmbedding::LoadLayer(std::istream* file) {
-    KASSERT(file, "Invalid file stream");
+bool KerasLayerEmbedding::LoadLayer(KerasReader* reader) {
+    KASSERT(reader, "Invalid reader");
 
     unsigned int weights_rows = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_rows), "Expected weight rows");
+    KASSERT(reader->ReadUnsignedInt(&weights_rows), "Expected weight rows");
     KASSERT(weights_rows > 0, "Invalid weights # rows");
 
     unsigned int weights_cols = 0;
-    KASSERT(ReadUnsignedInt(file, &weights_cols), "Expected weight cols");
+    KASSERT(reader->ReadUnsignedInt(&weights_cols), "Expected weight cols");
     KASSERT(weights_cols > 0, "Invalid weights shape");
 
-    weights_.Resize(weights_rows, weights_cols);
-    KASSERT(
-        ReadFloats(file, weights_.data_.data(), weights_rows * weights_cols),
-        "Expected weights");
+    KASSERT(reader->ReadTensor(&weights_, weights_rows, weights_cols), "Expected weights");
 
     return true;
 }
 
-bool KerasLayerEmbedding::Apply(Tensor* in, Tensor* out) {
+bool KerasLayerEmbedding::Apply(const Tensor* in, Tensor* out,
+                                KerasContext* /* ctx */) const {
+    KASSERT(in, "Invalid input");
+    KASSERT(out, "Invalid output");
+
     int output_rows = in->dims_[1];
     int output_cols = weights_.dims_[1];
-    out->dims_ = {output_rows, output_cols};
-    out->data_.reserve(output_rows * output_cols);
-
-    std::for_each(in->data_.begin(), in->data_.end(), [=](float i) {
-        std::vector<float>::const_iterator first =
-            this->weights_.data_.begin() + (i * output_cols);
-        std::vector<float>::const_iterator last =
-            this->weights_.data_.begin() + (i + 1) * output_cols;
-
-        out->data_.insert(out->data_.end(), first, last);
-    });
+    KASSERT((int)in->data_.size() == output_rows, "Invalid input dimensions");
+    out->Resize(output_rows, output_cols);
+
+    for (int row = 0; row < output_rows; row++) {
+        const int i = (int)in->data_[row];
+        KASSERT(i >= 0 && i < weights_.dims_[0], "Invalid index %d", i);
+        std::copy(weights_.Data() + (size_t)i * output_cols,
+                  weights_.Data() + (size_t)(i + 1) * output_cols,
+                  out->data_.begin() + (size_t)row * output_cols);
+    }
 
     return true;
 }
 
-bool KerasLayerLSTM::Step(Tensor* x, Tensor* out, Tensor* ht_1, Tensor* ct_1) {
-    Tensor xi = x->Dot(Wi_) + bi_;
-    Tensor xf = x->Dot(Wf_) + bf_;
-    Tensor xc = x->Dot(Wc_) + bc_;
-    Tensor xo = x->Dot(Wo_) + bo_;
+// out = x * w for the row major (rows x cols) matrix w. The rows are the
+// outer loop so that the inner loop runs over contiguous memory, every
+// output still sums over k in ascending order.
+static inline void Gemv(const float* x, int rows, const Tensor& w,
+                        float* __restrict__ out) {
+    const int cols = w.dims_[1];
+    std::fill(out, out + cols, 0.0f);
+    for (int k = 0; k < rows; k++) {
+        const float value = x[k];
+        const float* __restrict__ row = w.data_.data() + (size_t)k * cols;
+        for (int j = 0; j < cols; j++) {
+            out[j] += value * row[j];
+        }
+    }
+}
+
+// exp(x) by range reduction to [-ln(2)/2, ln(2)/2] and the polynomial of
+// the Cephes expf, without branches so that loops over it vectorize. The
+// input is clamped to the range of normal floats.
+static inline float FastExp(float x) {
+    x = (x > 88.3762626647949f) ? 88.3762626647949f : x;
+    x = (x < -87.3365447504019f) ? -87.3365447504019f : x;
+
+    // round to nearest by adding 1.5 * 2^23
+    const float magic = 12582912.0f;
+    const float n = (x * 1.44269504088896341f + magic) - magic;
+    const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+
+    const int32_t bits = ((int32_t)n + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+}
 
-    Tensor i_ = xi + ht_1->Dot(Ui_);
-    Tensor f_ = xf + ht_1->Dot(Uf_);
-    Tensor c_ = xc + ht_1->Dot(Uc_);
-    Tensor o_ = xo + ht_1->Dot(Uo_);
+// Sigmoid and tanh are the usual LSTM activations, they use FastExp (about
+// 2e-7 absolute error). Other activations use the exact implementation.
+static void ApplyGateActivation(const KerasLayerActivation& activation,
+                                float* __restrict__ data, int n) {
+    switch (activation.activation_type()) {
+    case KerasLayerActivation::kSigmoid:
+        for (int i = 0; i < n; i++) {
+            data[i] = 1.0f / (1.0f + FastExp(-data[i]));
+        }
+        break;
+    case KerasLayerActivation::kTanh:
+        for (int i = 0; i < n; i++) {
+            data[i] = 1.0f - 2.0f / (FastExp(2.0f * data[i]) + 1.0f);
+        }
+        break;
+    default:
+        activation.ApplyInPlace(data, n);
+        break;
+    }
+}
 
-    Tensor i, f, cc, o;
+bool KerasLayerLSTM::Step(const float* x, float* ht, float* ct,
+                          float* gates) const {
+    const int outputDim = output_dim_;
+    const int fused = 4 * outputDim;
+    float* i = gates;
+    float* f = gates + outputDim;
+    float* cc = gates + 2 * outputDim;
+    float* o = gates + 3 * outputDim;
+    float* h_dot = gates + fused;
+
+    // x * W + b + h * U for all four gates with one GEMV each
+    Gemv(x, input_dim_, W_, gates);
+    Gemv(ht, outputDim, U_, h_dot);
+    for (int j = 0; j < fused; j++) {
+        gates[j] = (gates[j] + b_.data_[j]) + h_dot[j];
+    }
 
-    KASSERT(innerActivation_.Apply(&i_, &i),
-            "Failed to apply inner activation on i");
-    KASSERT(innerActivation_.Apply(&f_, &f),
-            "Failed to apply inner activation on f");
-    KASSERT(activation_.Apply(&c_, &cc), "Failed to apply activation on c_");
-    KASSERT(innerActivation_.Apply(&o_, &o),
-            "Failed to apply inner activation on o");
+    ApplyGateActivation(innerActivation_, i, 2 * outputDim);
+    ApplyGateActivation(activation_, cc, outputDim);
+    ApplyGateActivation(innerActivation_, o, outputDim);
 
-    *ct_1 = f.Multiply(*ct_1) + i.Multiply(cc);
+    for (int j = 0; j < outputDim; j++) {
+        ct[j] = f[j] * ct[j] + i[j] * cc[j];
+    }
 
-    KASSERT(activation_.Apply(ct_1, &cc), "Failed to apply activation on c");
-    *out = *ht_1 = o.Multiply(cc);
+    // cc is not needed anymore and holds the activated cell state
+    for (int j = 0; j < outputDim; j++) {
+        cc[j] = ct[j];
+    }
+    ApplyGateActivation(activation_, cc, outputDim);
+    for (int j = 0; j < outputDim; j++) {
+        ht[j] = o[j] * cc[j];
+    }
 
     return true;
 }
 
 bool KerasModel::LoadModel(const std::string& data) {
-    std::stringstream file(data);
+    // The model might use the data in place, keep a copy.
+    storage_.resize((data.size() + sizeof(float) - 1) / sizeof(float));
+    memcpy(storage_.data(), data.data(), data.size());
+
+    return LoadLayers((const char*)storage_.data(), data.size(), NULL);
+}
+
+bool KerasModel::LoadModel(const char* data, size_t size) {
+    // Floats can only be used in place at a float aligned address.
+    if ((uintptr_t)data % sizeof(float) != 0) {
+        return LoadModel(std::string(data, size));
+    }
+
+    return LoadLayers(data, size, NULL);
+}
+
+bool KerasModel::ConvertToAligned(const std::string& data, std::string* out) {
+    KASSERT(out, "Invalid output");
+
+    const unsigned int header[2] = {kAlignedMagic, kAlignedVersion};
+    out->assign((const char*)header, sizeof(header));
+
+    KerasModel model;
+    model.storage_.resize((data.size() + sizeof(float) - 1) / sizeof(float));
+    memcpy(model.storage_.data(), data.data(), data.size());
+
+    return model.LoadLayers((const char*)model.storage_.data(), data.size(),
+                            out);
+}
+
+bool KerasModel::LoadLayers(const char* data, size_t size,
+                            std::string* record) {
+    KASSERT(data, "Invalid data");
+
+    bool aligned = false;
+    size_t offset = 0;
+    unsigned int header[2] = {0, 0};
+    if (size >= sizeof(header)) {
+        memcpy(header, data, sizeof(header));
+    }
+    if (header[0] == kAlignedMagic) {
+        KASSERT(header[1] == kAlignedVersion,
+                "Unsupported aligned model version %d", header[1]);
+        aligned = true;
+        offset = sizeof(header);
+    }
+
+    KerasReader reader(data, size, offset, aligned);
+    reader.Record(record);
 
     unsigned int num_layers = 0;
-    KASSERT(ReadUnsignedInt(&file, &num_layers), "Expected number of layers");
+    KASSERT(reader.ReadUnsignedInt(&num_layers), "Expected number of layers");
 
     for (unsigned int i = 0; i < num_layers; i++) {
         unsigned int layer_type = 0;
-        KASSERT(ReadUnsignedInt(&file, &layer_type), "Expected layer type");
+        KASSERT(reader.ReadUnsignedInt(&layer_type), "Expected layer type");
 
         KerasLayer* layer = NULL;
 
@@ -647,13 +1109,16 @@ bool KerasModel::LoadModel(const std::string& data) {
         case kEmbedding:
             layer = new KerasLayerEmbedding();
             break;
+        case kConvolution1d:
+            layer = new KerasLayerConvolution1d();
+            break;
         default:
             break;
         }
 
         KASSERT(layer, "Unknown layer type %d", layer_type);
 
-        bool result = layer->LoadLayer(&file);
+        bool result = layer->LoadLayer(&reader);
         if (!result) {
             printf("Failed to load layer %d", i);
             delete layer;
@@ -667,20 +1132,53 @@ bool KerasModel::LoadModel(const std::string& data) {
 }
 
 bool KerasModel::Apply(Tensor* in, Tensor* out) {
-    Tensor temp_in, temp_out;
+    KerasContext ctx(*this);
+
+    return Apply(in, out, &ctx);
+}
 
+bool KerasModel::Apply(const Tensor* in, Tensor* out,
+                       KerasContext* ctx) const {
+    KASSERT(in, "Invalid input");
+    KASSERT(out, "Invalid output");
+    KASSERT(ctx, "Invalid context");
+    KASSERT(layers_.size() > 0, "Empty model");
+
+    const Tensor* current = in;
     for (unsigned int i = 0; i < layers_.size(); i++) {
-        if (i == 0) {
-            temp_in = *in;
+        Tensor* next = out;
+        if (i + 1 < layers_.size()) {
+            next = &ctx->buffers_[i % 2];
         }
 
-        KASSERT(layers_[i]->Apply(&temp_in, &temp_out),
+        KASSERT(layers_[i]->Apply(current, next, ctx),
                 "Failed to apply layer %d", i);
 
-        temp_in = temp_out;
+        current = next;
+    }
+
+    return true;
+}
+
+size_t KerasModel::MaxOutputSize() const {
+    size_t max_size = 0;
+    for (unsigned int i = 0; i < layers_.size(); i++) {
+        max_size = std::max(max_size, layers_[i]->OutputSize());
     }
 
-    *out = temp_out;
+    return max_size;
+}
+
+KerasContext::KerasContext(const KerasModel& model) {
+    const size_t size = model.MaxOutputSize();
+    buffers_[0].data_.reserve(size);
+    buffers_[1].data_.reserve(size);
+}
+
+bool KerasModel::Quantize() {
+    for (unsigned int i = 0; i < layers_.size(); i++) {
+        KASSERT(layers_[i]->Quantize(), "Failed to quantize layer %d", i);
+    }
 
     return true;
 }
@@ -11,6 +11,7 @@
 #include <chrono>
 #include <math.h>
 #include <numeric>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -40,36 +41,55 @@
 #define KDEBUG(x, ...) ;
 #endif
 
+// Float arrays of aligned models start at multiples of this many bytes.
+static const size_t kKerasAlignment = 64;
+
 class Tensor {
   public:
-    Tensor() {}
+    Tensor() : view_(NULL) {}
 
-    Tensor(int i) { Resize(i); }
+    Tensor(int i) : view_(NULL) { Resize(i); }
 
-    Tensor(int i, int j) { Resize(i, j); }
+    Tensor(int i, int j) : view_(NULL) { Resize(i, j); }
 
-    Tensor(int i, int j, int k) { Resize(i, j, k); }
+    Tensor(int i, int j, int k) : view_(NULL) { Resize(i, j, k); }
 
-    Tensor(int i, int j, int k, int l) { Resize(i, j, k, l); }
+    Tensor(int i, int j, int k, int l) : view_(NULL) { Resize(i, j, k, l); }
 
     void Resize(int i) {
         dims_ = {i};
         data_.resize(i);
+        view_ = NULL;
     }
 
     void Resize(int i, int j) {
         dims_ = {i, j};
         data_.resize(i * j);
+        view_ = NULL;
     }
 
     void Resize(int i, int j, int k) {
         dims_ = {i, j, k};
         data_.resize(i * j * k);
+        view_ = NULL;
     }
 
     void Resize(int i, int j, int k, int l) {
         dims_ = {i, j, k, l};
         data_.resize(i * j * k * l);
+        view_ = NULL;
+    }
+
+    // Uses data in place instead of data_, the memory has to outlive the
+    // tensor. Only for read-only tensors such as weights.
+    void View(const float* data) {
+        std::vector<float>().swap(data_);
+        view_ = data;
+    }
+
+    // Read-only access that works for owned and viewed data.
+    inline const float* Data() const {
+        return (view_ != NULL) ? view_ : data_.data();
     }
 
     inline void Flatten() {
@@ -89,6 +109,13 @@ class Tensor {
         return data_[i];
     }
 
+    inline float operator()(int i) const {
+        KDEBUG(dims_.size() == 1, "Invalid indexing for tensor");
+        KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
+
+        return Data()[i];
+    }
+
     inline float& operator()(int i, int j) {
         KDEBUG(dims_.size() == 2, "Invalid indexing for tensor");
         KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
@@ -102,7 +129,7 @@ class Tensor {
         KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
         KDEBUG(j < dims_[1] && j >= 0, "Invalid j: %d (max %d)", j, dims_[1]);
 
-        return data_[dims_[1] * i + j];
+        return Data()[dims_[1] * i + j];
     }
 
     inline float& operator()(int i, int j, int k) {
@@ -114,6 +141,15 @@ class Tensor {
         return data_[dims_[2] * (dims_[1] * i + j) + k];
     }
 
+    inline float operator()(int i, int j, int k) const {
+        KDEBUG(dims_.size() == 3, "Invalid indexing for tensor");
+        KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
+        KDEBUG(j < dims_[1] && j >= 0, "Invalid j: %d (max %d)", j, dims_[1]);
+        KDEBUG(k < dims_[2] && k >= 0, "Invalid k: %d (max %d)", k, dims_[2]);
+
+        return Data()[dims_[2] * (dims_[1] * i + j) + k];
+    }
+
     inline float& operator()(int i, int j, int k, int l) {
         KDEBUG(dims_.size() == 4, "Invalid indexing for tensor");
         KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
@@ -124,6 +160,16 @@ class Tensor {
         return data_[dims_[3] * (dims_[2] * (dims_[1] * i + j) + k) + l];
     }
 
+    inline float operator()(int i, int j, int k, int l) const {
+        KDEBUG(dims_.size() == 4, "Invalid indexing for tensor");
+        KDEBUG(i < dims_[0] && i >= 0, "Invalid i: %d (max %d)", i, dims_[0]);
+        KDEBUG(j < dims_[1] && j >= 0, "Invalid j: %d (max %d)", j, dims_[1]);
+        KDEBUG(k < dims_[2] && k >= 0, "Invalid k: %d (max %d)", k, dims_[2]);
+        KDEBUG(l < dims_[3] && l >= 0, "Invalid l: %d (max %d)", l, dims_[3]);
+
+        return Data()[dims_[3] * (dims_[2] * (dims_[1] * i + j) + k) + l];
+    }
+
     inline void Fill(float value) {
         std::fill(data_.begin(), data_.end(), value);
     }
@@ -264,6 +310,83 @@ class Tensor {
 
     std::vector<int> dims_;
     std::vector<float> data_;
+    const float* view_;
+};
+
+// Reads a model from memory. In the aligned layout every tensor starts at a
+// multiple of kKerasAlignment bytes and is used in place, otherwise it is
+// copied. If recording, everything read is also written in the aligned
+// layout to the record string.
+class KerasReader {
+  public:
+    KerasReader(const char* data, size_t size, size_t offset, bool aligned)
+        : data_(data), size_(size), offset_(offset), aligned_(aligned),
+          record_(NULL) {}
+
+    void Record(std::string* record) { record_ = record; }
+
+    bool ReadUnsignedInt(unsigned int* i);
+
+    bool ReadFloat(float* f);
+
+    // Reads a tensor of the given shape.
+    bool ReadTensor(Tensor* t, int i);
+
+    bool ReadTensor(Tensor* t, int i, int j);
+
+    bool ReadTensor(Tensor* t, int i, int j, int k);
+
+    bool ReadTensor(Tensor* t, int i, int j, int k, int l);
+
+  private:
+    bool Align();
+
+    bool ReadTensorData(Tensor* t);
+
+    void Write(const void* data, size_t n, bool align);
+
+    const char* data_;
+    size_t size_;
+    size_t offset_;
+    bool aligned_;
+    std::string* record_;
+};
+
+class KerasModel;
+
+// Scratch memory of one thread for KerasModel::Apply. The buffers only grow,
+// after the first call with the largest input Apply does not allocate
+// anymore. The model itself is read-only and can be shared between threads
+// that each own a context.
+class KerasContext {
+  public:
+    KerasContext() {}
+
+    // Reserves the activation buffers for the layer sizes known from the
+    // model.
+    explicit KerasContext(const KerasModel& model);
+
+    // Returns memory for at least n floats, valid until the next call.
+    float* Workspace(size_t n) {
+        if (workspace_.size() < n) {
+            workspace_.resize(n);
+        }
+        return workspace_.data();
+    }
+
+    uint8_t* ByteWorkspace(size_t n) {
+        if (byte_workspace_.size() < n) {
+            byte_workspace_.resize(n);
+        }
+        return byte_workspace_.data();
+    }
+
+    // Ping-pong buffers for the activations between layers.
+    Tensor buffers_[2];
+
+  private:
+    std::vector<float> workspace_;
+    std::vector<uint8_t> byte_workspace_;
 };
 
 class KerasLayer {
@@ -272,9 +395,19 @@ class KerasLayer {
 
     virtual ~KerasLayer() {}
 
-    virtual bool LoadLayer(std::istream* file) = 0;
+    virtual bool LoadLayer(KerasReader* reader) = 0;
 
-    virtual bool Apply(Tensor* in, Tensor* out) = 0;
+    // Writes the result into out, which is resized in place. in and out are
+    // never the same tensor.
+    virtual bool Apply(const Tensor* in, Tensor* out,
+                       KerasContext* ctx) const = 0;
+
+    // Number of outputs if it does not depend on the input, 0 otherwise.
+    virtual size_t OutputSize() const { return 0; }
+
+    // Post-training int8 quantization, layers without weights keep their
+    // float implementation.
+    virtual bool Quantize() { return true; }
 };
 
 class KerasLayerActivation : public KerasLayer {
@@ -292,9 +425,13 @@ class KerasLayerActivation : public KerasLayer {
 
     virtual ~KerasLayerActivation() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
+
+    void ApplyInPlace(float* data, size_t n) const;
+
+    ActivationType activation_type() const { return activation_type_; }
 
   private:
     ActivationType activation_type_;
@@ -302,18 +439,37 @@ class KerasLayerActivation : public KerasLayer {
 
 class KerasLayerDense : public KerasLayer {
   public:
-    KerasLayerDense() {}
+    KerasLayerDense() : quantized_(false), quantized_rows_(0) {}
 
     virtual ~KerasLayerDense() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
+
+    // Quantizes the weights to int8 with one scale per output channel and
+    // releases the float weights. Inputs are quantized per call to 7 bit, the
+    // products are accumulated in int32 and dequantized before the
+    // activation.
+    virtual bool Quantize();
+
+    virtual size_t OutputSize() const { return weights_.dims_[1]; }
 
   private:
+    bool ApplyQuantized(const Tensor* in, Tensor* out, KerasContext* ctx) const;
+
     Tensor weights_;
     Tensor biases_;
 
+    bool quantized_;
+    // input dimension padded to a multiple of kQuantizedBlock
+    int quantized_rows_;
+    // transposed weights (output channel x quantized_rows_)
+    std::vector<int8_t> quantized_weights_;
+    std::vector<float> quantized_scales_;
+    // sum of the quantized weights of each output channel
+    std::vector<int32_t> quantized_sums_;
+
     KerasLayerActivation activation_;
 };
 
@@ -323,9 +479,30 @@ class KerasLayerConvolution2d : public KerasLayer {
 
     virtual ~KerasLayerConvolution2d() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
+
+  private:
+    Tensor weights_;
+    Tensor biases_;
+
+    KerasLayerActivation activation_;
+};
+
+// 1D convolution over a sequence with 'valid' padding. The input is
+// (steps x channels) and the output (steps - kernel_size + 1 x filters).
+// The weights are stored as in Keras (kernel_size x channels x filters), so
+// each output step is a dense layer over kernel_size consecutive input rows.
+class KerasLayerConvolution1d : public KerasLayer {
+  public:
+    KerasLayerConvolution1d() {}
+
+    virtual ~KerasLayerConvolution1d() {}
+
+    virtual bool LoadLayer(KerasReader* reader);
+
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
     Tensor weights_;
@@ -340,9 +517,9 @@ class KerasLayerFlatten : public KerasLayer {
 
     virtual ~KerasLayerFlatten() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
 };
@@ -353,9 +530,9 @@ class KerasLayerElu : public KerasLayer {
 
     virtual ~KerasLayerElu() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
     float alpha_;
@@ -367,9 +544,9 @@ class KerasLayerMaxPooling2d : public KerasLayer {
 
     virtual ~KerasLayerMaxPooling2d() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
     unsigned int pool_size_j_;
@@ -378,16 +555,22 @@ class KerasLayerMaxPooling2d : public KerasLayer {
 
 class KerasLayerLSTM : public KerasLayer {
   public:
-    KerasLayerLSTM() : return_sequences_(false) {}
+    KerasLayerLSTM() : input_dim_(0), output_dim_(0), return_sequences_(false) {}
 
     virtual ~KerasLayerLSTM() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
-    bool Step(Tensor* x, Tensor* out, Tensor* ht_1, Tensor* ct_1);
+    // Concatenates the weights of the four gates into W_, U_ and b_ and
+    // releases the per gate weights.
+    bool FuseGates();
+
+    // Computes the next hidden state ht and cell state ct from the input
+    // x, gates holds 8 * output_dim_ floats of scratch memory.
+    bool Step(const float* x, float* ht, float* ct, float* gates) const;
 
     Tensor Wi_;
     Tensor Ui_;
@@ -402,6 +585,15 @@ class KerasLayerLSTM : public KerasLayer {
     Tensor Uo_;
     Tensor bo_;
 
+    int input_dim_;
+    int output_dim_;
+    // Fused gate weights in the order i, f, c, o, every row of W_
+    // (input_dim_ x 4 * output_dim_) and U_ (output_dim_ x 4 * output_dim_)
+    // holds the rows of the four gates next to each other.
+    Tensor W_;
+    Tensor U_;
+    Tensor b_;
+
     KerasLayerActivation innerActivation_;
     KerasLayerActivation activation_;
     bool return_sequences_;
@@ -413,9 +605,9 @@ class KerasLayerEmbedding : public KerasLayer {
 
     virtual ~KerasLayerEmbedding() {}
 
-    virtual bool LoadLayer(std::istream* file);
+    virtual bool LoadLayer(KerasReader* reader);
 
-    virtual bool Apply(Tensor* in, Tensor* out);
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
 
   private:
     Tensor weights_;
@@ -431,7 +623,8 @@ class KerasModel {
         kActivation = 5,
         kMaxPooling2D = 6,
         kLSTM = 7,
-        kEmbedding = 8
+        kEmbedding = 8,
+        kConvolution1d = 9
     };
 
     KerasModel() {}
@@ -442,12 +635,40 @@ class KerasModel {
         }
     }
 
-    virtual bool LoadModel(const std::string& filename);
+    // Loads a model in the kerasify or the aligned layout. The data is
+    // copied, so it does not have to outlive the model.
+    virtual bool LoadModel(const std::string& data);
+
+    // Aligned models are used in place without copying the weights, the
+    // data has to outlive the model. Other models are copied.
+    virtual bool LoadModel(const char* data, size_t size);
+
+    // Converts a model from the kerasify layout to the aligned layout.
+    static bool ConvertToAligned(const std::string& data, std::string* out);
 
+    // Convenience version that uses a temporary context.
     virtual bool Apply(Tensor* in, Tensor* out);
 
+    // Does not change the model, several threads can call Apply at the
+    // same time with their own context.
+    virtual bool Apply(const Tensor* in, Tensor* out, KerasContext* ctx) const;
+
+    // Largest number of outputs of the layers with a fixed output size.
+    size_t MaxOutputSize() const;
+
+    // Switches all layers that support it to int8 inference.
+    virtual bool Quantize();
+
   private:
+    // "KRAL" at the start of an aligned model
+    static const unsigned int kAlignedMagic = 0x4c41524b;
+    static const unsigned int kAlignedVersion = 1;
+
+    bool LoadLayers(const char* data, size_t size, std::string* record);
+
     std::vector<KerasLayer*> layers_;
+    // copy of the model data if the tensors can not point to the caller's
+    std::vector<float> storage_;
 };
 
 class KerasTimer {
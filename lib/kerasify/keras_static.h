@@ -0,0 +1,88 @@
+/*
+ * Compile-time specialized forward pass for models converted with
+ * kerasify2header. All dimensions are template parameters so that the
+ * compiler can unroll and vectorize the layers, the weights are constexpr
+ * arrays in the generated header.
+ */
+
+#ifndef KERAS_STATIC_H_
+#define KERAS_STATIC_H_
+
+#include <cmath>
+
+namespace keras_static {
+
+// Same values as KerasLayerActivation::ActivationType
+enum ActivationType {
+    kLinear = 1,
+    kRelu = 2,
+    kSoftPlus = 3,
+    kSigmoid = 4,
+    kTanh = 5,
+    kHardSigmoid = 6
+};
+
+template <int ACTIVATION> inline float Activate(float x);
+
+template <> inline float Activate<kLinear>(float x) { return x; }
+
+template <> inline float Activate<kRelu>(float x) {
+    return (x < 0.0f) ? 0.0f : x;
+}
+
+template <> inline float Activate<kSoftPlus>(float x) {
+    return std::log(1.0 + std::exp(x));
+}
+
+template <> inline float Activate<kHardSigmoid>(float x) {
+    float y = (x * 0.2) + 0.5;
+    if (y <= 0) {
+        return 0.0f;
+    } else if (y >= 1) {
+        return 1.0f;
+    }
+    return y;
+}
+
+template <> inline float Activate<kSigmoid>(float x) {
+    if (x >= 0) {
+        return 1.0 / (1.0 + std::exp(-x));
+    }
+    float z = std::exp(x);
+    return z / (1.0 + z);
+}
+
+template <> inline float Activate<kTanh>(float x) { return std::tanh(x); }
+
+// out = activation(in * weights + biases), weights are stored row major
+// (IN x OUT) as in the kerasify format. The accumulation order is the same as
+// KerasLayerDense::Apply.
+template <int IN, int OUT, int ACTIVATION>
+inline void Dense(const float* __restrict__ in,
+                  const float* __restrict__ weights,
+                  const float* __restrict__ biases, float* __restrict__ out) {
+    for (int j = 0; j < OUT; j++) {
+        out[j] = 0.0f;
+    }
+    for (int i = 0; i < IN; i++) {
+        const float x = in[i];
+        const float* __restrict__ row = weights + i * OUT;
+        for (int j = 0; j < OUT; j++) {
+            out[j] += x * row[j];
+        }
+    }
+    for (int j = 0; j < OUT; j++) {
+        out[j] = Activate<ACTIVATION>(out[j] + biases[j]);
+    }
+}
+
+// Standalone activation layer, applied in place
+template <int N, int ACTIVATION> inline void Activation(float* data) {
+    for (int i = 0; i < N; i++) {
+        data[i] = Activate<ACTIVATION>(data[i]);
+    }
+}
+
+} // namespace keras_static
+
+#endif // KERAS_STATIC_H_
@@ -0,0 +1,72 @@
+/*
+ * Converts a kerasify model into the aligned layout that KerasModel can use
+ * in place (see KerasReader). With an array name the output is a C++ header
+ * with the model as an aligned byte array, otherwise the binary model.
+ *
+ * Usage: kerasify2aligned <model file> <output file> [<array name>]
+ */
+
+#include "keras_model.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr,
+                "Usage: %s <model file> <output file> [<array name>]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file.is_open()) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    std::string aligned;
+    if (!KerasModel::ConvertToAligned(buffer.str(), &aligned)) {
+        fprintf(stderr, "Could not convert %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = fopen(argv[2], argc == 4 ? "w" : "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s for writing\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    bool success = true;
+    if (argc == 3) {
+        success = fwrite(aligned.data(), 1, aligned.size(), out) ==
+                  aligned.size();
+    } else {
+        const char* name = argv[3];
+        fprintf(out, "// Generated by kerasify2aligned, do not edit.\n");
+        fprintf(out, "alignas(%zu) const unsigned char %s[] = {", kKerasAlignment,
+                name);
+        for (size_t i = 0; i < aligned.size(); i++) {
+            fprintf(out, "%s0x%02x", (i % 12 == 0) ? "\n    " : " ",
+                    (unsigned char)aligned[i]);
+            if (i + 1 < aligned.size()) {
+                fprintf(out, ",");
+            }
+        }
+        fprintf(out, "\n};\n");
+        success = fprintf(out, "const unsigned int %s_len = %zu;\n", name,
+                          aligned.size()) > 0;
+    }
+
+    if (fclose(out) != 0 || !success) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
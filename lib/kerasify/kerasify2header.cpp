@@ -0,0 +1,239 @@
+/*
+ * Converts a kerasify model into a C++ header with the weights as constexpr
+ * arrays and a forward pass specialized on the layer dimensions (see
+ * keras_static.h). Only dense and activation layers are supported.
+ *
+ * Usage: kerasify2header <model file> <namespace> <output header>
+ */
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum LayerType { kDense = 1, kActivation = 5 };
+
+struct Layer {
+    unsigned int type;
+    unsigned int rows;
+    unsigned int cols;
+    unsigned int activation;
+    std::vector<float> weights;
+    std::vector<float> biases;
+};
+
+bool ReadUnsignedInt(std::ifstream& file, unsigned int* i) {
+    file.read((char*)i, sizeof(unsigned int));
+    return file.gcount() == sizeof(unsigned int);
+}
+
+bool ReadFloats(std::ifstream& file, std::vector<float>& f, size_t n) {
+    f.resize(n);
+    file.read((char*)f.data(), sizeof(float) * n);
+    return (size_t)file.gcount() == sizeof(float) * n;
+}
+
+bool LoadLayers(const char* filename, std::vector<Layer>& layers) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return false;
+    }
+
+    unsigned int num_layers = 0;
+    if (!ReadUnsignedInt(file, &num_layers)) {
+        fprintf(stderr, "Expected number of layers\n");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < num_layers; i++) {
+        Layer layer;
+        layer.rows = 0;
+        layer.cols = 0;
+        if (!ReadUnsignedInt(file, &layer.type)) {
+            fprintf(stderr, "Expected layer type\n");
+            return false;
+        }
+
+        if (layer.type == kDense) {
+            unsigned int biases_shape = 0;
+            if (!ReadUnsignedInt(file, &layer.rows) ||
+                !ReadUnsignedInt(file, &layer.cols) ||
+                !ReadUnsignedInt(file, &biases_shape)) {
+                fprintf(stderr, "Expected dense layer shape\n");
+                return false;
+            }
+            if (layer.rows == 0 || layer.cols == 0 ||
+                biases_shape != layer.cols) {
+                fprintf(stderr, "Invalid dense layer shape\n");
+                return false;
+            }
+            if (!ReadFloats(file, layer.weights, layer.rows * layer.cols) ||
+                !ReadFloats(file, layer.biases, biases_shape)) {
+                fprintf(stderr, "Expected dense layer weights\n");
+                return false;
+            }
+        } else if (layer.type != kActivation) {
+            fprintf(stderr, "Unsupported layer type %d\n", layer.type);
+            return false;
+        }
+
+        if (!ReadUnsignedInt(file, &layer.activation) ||
+            layer.activation < 1 || layer.activation > 6) {
+            fprintf(stderr, "Unsupported activation type in layer %d\n", i);
+            return false;
+        }
+        layers.push_back(layer);
+    }
+
+    return true;
+}
+
+bool WriteArray(FILE* out, const char* name, unsigned int layer,
+                const std::vector<float>& data) {
+    fprintf(out, "alignas(32) constexpr float layer%u_%s[%zu] = {", layer, name,
+            data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        if (!std::isfinite(data[i])) {
+            fprintf(stderr, "Invalid value in layer %u\n", layer);
+            return false;
+        }
+        fprintf(out, "%s%.9gf", (i % 8 == 0) ? "\n    " : " ", data[i]);
+        if (i + 1 < data.size()) {
+            fprintf(out, ",");
+        }
+    }
+    fprintf(out, "\n};\n\n");
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr,
+                "Usage: %s <model file> <namespace> <output header>\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Layer> layers;
+    if (!LoadLayers(argv[1], layers)) {
+        return EXIT_FAILURE;
+    }
+
+    unsigned int input_size = 0;
+    unsigned int size = 0;
+    unsigned int max_size = 0;
+    int last_dense = -1;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].type != kDense) {
+            continue;
+        }
+        if (input_size == 0) {
+            input_size = layers[i].rows;
+        } else if (layers[i].rows != size) {
+            fprintf(stderr, "Dimension mismatch in layer %zu\n", i);
+            return EXIT_FAILURE;
+        }
+        size = layers[i].cols;
+        if (size > max_size) {
+            max_size = size;
+        }
+        last_dense = i;
+    }
+    if (last_dense == -1) {
+        fprintf(stderr, "Model needs at least one dense layer\n");
+        return EXIT_FAILURE;
+    }
+    if (input_size > max_size) {
+        max_size = input_size;
+    }
+
+    FILE* out = fopen(argv[3], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s for writing\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string name(argv[2]);
+    std::string guard;
+    for (size_t i = 0; i < name.size(); i++) {
+        guard.push_back(toupper(name[i]));
+    }
+    fprintf(out, "// Generated by kerasify2header, do not edit.\n");
+    fprintf(out, "#ifndef %s_STATIC_H_\n#define %s_STATIC_H_\n\n",
+            guard.c_str(), guard.c_str());
+    fprintf(out, "#include \"kerasify/keras_static.h\"\n\n");
+    fprintf(out, "namespace %s_static {\n\n", name.c_str());
+    fprintf(out, "const int kInputSize = %u;\n", input_size);
+    fprintf(out, "const int kOutputSize = %u;\n\n", size);
+
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].type != kDense) {
+            continue;
+        }
+        if (!WriteArray(out, "weights", i, layers[i].weights) ||
+            !WriteArray(out, "biases", i, layers[i].biases)) {
+            fclose(out);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // the input is read-only, an activation before the first dense layer
+    // works on a copy
+    std::string body;
+    bool used[2] = {false, false};
+    char line[256];
+    std::string current = "in";
+    if (layers[0].type != kDense) {
+        snprintf(line, sizeof(line),
+                 "    for (int i = 0; i < %u; i++) {\n"
+                 "        buffer0[i] = in[i];\n    }\n", input_size);
+        body += line;
+        current = "buffer0";
+        used[0] = true;
+    }
+    size = input_size;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].type == kDense) {
+            std::string next = "out";
+            if ((int)i != last_dense) {
+                int buffer = (current == "buffer0") ? 1 : 0;
+                used[buffer] = true;
+                next = (buffer == 0) ? "buffer0" : "buffer1";
+            }
+            snprintf(line, sizeof(line),
+                     "    keras_static::Dense<%u, %u, %u>(%s, layer%zu_weights, "
+                     "layer%zu_biases, %s);\n",
+                     layers[i].rows, layers[i].cols, layers[i].activation,
+                     current.c_str(), i, i, next.c_str());
+            body += line;
+            current = next;
+            size = layers[i].cols;
+        } else {
+            snprintf(line, sizeof(line),
+                     "    keras_static::Activation<%u, %u>(%s);\n", size,
+                     layers[i].activation, current.c_str());
+            body += line;
+        }
+    }
+
+    fprintf(out, "inline void Apply(const float* in, float* out) {\n");
+    for (int i = 0; i < 2; i++) {
+        if (used[i]) {
+            fprintf(out, "    alignas(32) float buffer%d[%u];\n", i, max_size);
+        }
+    }
+    fprintf(out, "%s", body.c_str());
+    fprintf(out, "}\n\n");
+    fprintf(out, "} // namespace %s_static\n\n#endif\n", name.c_str());
+
+    fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -9,7 +9,12 @@ extern int hybridassembler(int argc, const char** argv, const Command &command);
 extern int assembleresult(int argc, const char** argv, const Command &command);
 extern int hybridassembleresults(int argc, const char** argv, const Command &command);
 extern int filternoncoding(int argc, const char** argv, const Command &command);
+extern int checkcodingmodel(int argc, const char** argv, const Command &command);
 extern int mergereads(int argc, const char** argv, const Command &command);
+extern int dereplicate(int argc, const char** argv, const Command &command);
+extern int diginorm(int argc, const char** argv, const Command &command);
+extern int filtersolidkmers(int argc, const char** argv, const Command &command);
+extern int sixframeorfs(int argc, const char** argv, const Command &command);
 extern int findassemblystart(int argc, const char** argv, const Command &command);
 
 #endif
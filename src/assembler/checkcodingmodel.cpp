@@ -0,0 +1,151 @@
+#include "ReducedMatrix.h"
+#include "SubstitutionMatrix.h"
+
+#include "Debug.h"
+#include "DBReader.h"
+#include "Util.h"
+
+#include "LocalParameters.h"
+#include "CodingFeatureExtractor.h"
+#include "CodingModel.h"
+
+#include "kerasify/keras_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+struct CodingModelStats {
+    size_t total;
+    size_t agree;
+    size_t floatCorrect;
+    size_t int8Correct;
+    double sumDiff;
+    float maxDiff;
+    // sequences the prefilter rejects in each stage and how many of them the float model predicts as coding
+    size_t prefilterRejected[PREFILTER_STAGE_COUNT];
+    size_t prefilterFloatCoding[PREFILTER_STAGE_COUNT];
+
+    CodingModelStats() : total(0), agree(0), floatCorrect(0), int8Correct(0), sumDiff(0.0), maxDiff(0.0f),
+                         prefilterRejected(), prefilterFloatCoding() {}
+};
+
+// Scores all sequences of a database with the float and the int8 model,
+// the label is true for coding sequences
+static void scoreDatabase(const std::string &dbName, bool label, const KerasModel &floatModel, const KerasModel &int8Model,
+                          const BaseMatrix &subMat, const BaseMatrix &redMat, float threshold, CodingModelStats &stats) {
+    DBReader<unsigned int> seqDb(dbName.c_str(), (dbName + ".index").c_str());
+    seqDb.open(DBReader<unsigned int>::NOSORT);
+
+    size_t agree = 0;
+    size_t floatCorrect = 0;
+    size_t int8Correct = 0;
+    double sumDiff = 0.0;
+    float maxDiff = 0.0f;
+#pragma omp parallel reduction(+:agree, floatCorrect, int8Correct, sumDiff)
+    {
+        CodingFeatureExtractor extractor(subMat, redMat);
+        Tensor in(static_cast<int>(extractor.getFeatureCount()));
+        Tensor floatOut;
+        Tensor int8Out;
+        KerasContext floatContext(floatModel);
+        KerasContext int8Context(int8Model);
+        float threadMaxDiff = 0.0f;
+        size_t threadRejected[PREFILTER_STAGE_COUNT] = {};
+        size_t threadFloatCoding[PREFILTER_STAGE_COUNT] = {};
+
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < seqDb.getSize(); id++) {
+            char *seqData = seqDb.getData(id);
+            const size_t seqLen = seqDb.getSeqLens(id) - 1;
+            const size_t aaCount = extractor.extract(seqData, seqLen, in.data_.data());
+            floatModel.Apply(&in, &floatOut, &floatContext);
+            int8Model.Apply(&in, &int8Out, &int8Context);
+
+            const bool floatCoding = floatOut.data_[0] > threshold;
+            const bool int8Coding = int8Out.data_[0] > threshold;
+            agree += (floatCoding == int8Coding);
+            floatCorrect += (floatCoding == label);
+            int8Correct += (int8Coding == label);
+            const float diff = std::fabs(floatOut.data_[0] - int8Out.data_[0]);
+            sumDiff += diff;
+            threadMaxDiff = std::max(threadMaxDiff, diff);
+
+            const CodingPrefilterStage stage = codingPrefilterStage(seqData, seqLen, extractor, aaCount, subMat.alphabetSize);
+            threadRejected[stage]++;
+            threadFloatCoding[stage] += floatCoding;
+        }
+
+#pragma omp critical
+        {
+            maxDiff = std::max(maxDiff, threadMaxDiff);
+            for (size_t i = 0; i < PREFILTER_STAGE_COUNT; i++) {
+                stats.prefilterRejected[i] += threadRejected[i];
+                stats.prefilterFloatCoding[i] += threadFloatCoding[i];
+            }
+        }
+    }
+
+    stats.total += seqDb.getSize();
+    stats.agree += agree;
+    stats.floatCorrect += floatCorrect;
+    stats.int8Correct += int8Correct;
+    stats.sumDiff += sumDiff;
+    stats.maxDiff = std::max(stats.maxDiff, maxDiff);
+    seqDb.close();
+}
+
+int checkcodingmodel(int argc, const char **argv, const Command& command)  {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, 2);
+
+    SubstitutionMatrix subMat("blosum62.out", 2.0, 0.0);
+    ReducedMatrix redMat(subMat.probMatrix, subMat.subMatrixPseudoCounts, 7, subMat.getBitFactor());
+
+    KerasModel floatModel;
+    loadCodingModel(floatModel, par.codingModel);
+    KerasModel int8Model;
+    loadCodingModel(int8Model, par.codingModel);
+    if (int8Model.Quantize() == false) {
+        Debug(Debug::ERROR) << "Could not quantize coding model.\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    CodingModelStats coding;
+    scoreDatabase(par.db1, true, floatModel, int8Model, subMat, redMat, par.codingThreshold, coding);
+    CodingModelStats noncoding;
+    scoreDatabase(par.db2, false, floatModel, int8Model, subMat, redMat, par.codingThreshold, noncoding);
+
+    const size_t total = coding.total + noncoding.total;
+    if (total == 0) {
+        Debug(Debug::ERROR) << "Sequence databases are empty.\n";
+        EXIT(EXIT_FAILURE);
+    }
+    const double n = static_cast<double>(total);
+    Debug(Debug::INFO) << "Sequences: " << coding.total << " coding, " << noncoding.total << " non-coding\n";
+    Debug(Debug::INFO) << "Decision agreement float/int8: " << (coding.agree + noncoding.agree) / n << "\n";
+    Debug(Debug::INFO) << "Score difference: mean " << (coding.sumDiff + noncoding.sumDiff) / n
+                       << ", max " << std::max(coding.maxDiff, noncoding.maxDiff) << "\n";
+    Debug(Debug::INFO) << "Accuracy float: " << (coding.floatCorrect + noncoding.floatCorrect) / n
+                       << ", int8: " << (coding.int8Correct + noncoding.int8Correct) / n << "\n";
+    if (coding.total > 0) {
+        Debug(Debug::INFO) << "Recall coding float: " << coding.floatCorrect / static_cast<double>(coding.total)
+                           << ", int8: " << coding.int8Correct / static_cast<double>(coding.total) << "\n";
+    }
+    if (noncoding.total > 0) {
+        Debug(Debug::INFO) << "Rejected non-coding float: " << noncoding.floatCorrect / static_cast<double>(noncoding.total)
+                           << ", int8: " << noncoding.int8Correct / static_cast<double>(noncoding.total) << "\n";
+    }
+    // a rule is safe for --coding-prefilter if the float model predicts none of its rejections as coding
+    for (int stage = PREFILTER_PASS + 1; stage < PREFILTER_STAGE_COUNT; stage++) {
+        Debug(Debug::INFO) << "Prefilter " << codingPrefilterStageName(static_cast<CodingPrefilterStage>(stage))
+                           << ": rejects " << coding.prefilterRejected[stage] << " coding, "
+                           << noncoding.prefilterRejected[stage] << " non-coding, float model disagrees on "
+                           << coding.prefilterFloatCoding[stage] + noncoding.prefilterFloatCoding[stage] << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
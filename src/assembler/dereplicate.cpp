@@ -0,0 +1,240 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Sequence.h"
+#include "Debug.h"
+#include "Util.h"
+#include "LocalParameters.h"
+
+#include <algorithm>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// the highest hash bits select the partition of a read, all copies of a read fall into the same one
+static const unsigned int PARTITION_BITS = 12;
+
+struct ReadHash {
+    uint64_t hash;
+    unsigned int length;
+    size_t id;
+
+    bool operator<(const ReadHash &other) const {
+        if (hash != other.hash) {
+            return hash < other.hash;
+        }
+        if (length != other.length) {
+            return length < other.length;
+        }
+        return id < other.id;
+    }
+};
+
+static char complementBase(char c) {
+    switch (c) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        case 'a': return 't';
+        case 'c': return 'g';
+        case 'g': return 'c';
+        case 't': return 'a';
+        default:  return c;
+    }
+}
+
+// A read and its reverse complement are the same read, the lexicographically
+// smaller of the two strands represents both
+static bool isForwardCanonical(const char *seq, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const char rev = complementBase(seq[len - 1 - i]);
+        if (seq[i] != rev) {
+            return seq[i] < rev;
+        }
+    }
+    return true;
+}
+
+// FNV-1a over the canonical strand, without materializing the reverse complement
+static uint64_t hashCanonical(const char *seq, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    const bool forward = isForwardCanonical(seq, len);
+    for (size_t i = 0; i < len; i++) {
+        const char c = forward ? seq[i] : complementBase(seq[len - 1 - i]);
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool sameCanonical(const char *seq1, const char *seq2, size_t len) {
+    const bool forward1 = isForwardCanonical(seq1, len);
+    const bool forward2 = isForwardCanonical(seq2, len);
+    for (size_t i = 0; i < len; i++) {
+        const char c1 = forward1 ? seq1[i] : complementBase(seq1[len - 1 - i]);
+        const char c2 = forward2 ? seq2[i] : complementBase(seq2[len - 1 - i]);
+        if (c1 != c2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int dereplicate(int argc, const char **argv, const Command& command) {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, 2);
+
+    Debug(Debug::INFO) << "Sequence database: " << par.db1 << "\n";
+    DBReader<unsigned int> seqDb(par.db1.c_str(), par.db1Index.c_str());
+    seqDb.open(DBReader<unsigned int>::NOSORT);
+
+    std::string headerDbName = par.db1 + "_h";
+    DBReader<unsigned int> headerDb(headerDbName.c_str(), (headerDbName + ".index").c_str());
+    headerDb.open(DBReader<unsigned int>::NOSORT);
+
+    Debug(Debug::INFO) << "Output  file: " << par.db2 << "\n";
+
+    // Hash the canonical strand of every read and count the reads of each partition per thread.
+    // Every thread works on the same contiguous range of ids in both passes.
+    const size_t dbSize = seqDb.getSize();
+    const size_t partitionCount = static_cast<size_t>(1) << PARTITION_BITS;
+    unsigned int threads = 1;
+#ifdef OPENMP
+    threads = static_cast<unsigned int>(omp_get_max_threads());
+#endif
+    std::vector<uint64_t> readHashes(dbSize);
+    std::vector<size_t> partitionOffsets(threads * partitionCount, 0);
+#pragma omp parallel num_threads(threads)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        size_t *counts = &partitionOffsets[thread_idx * partitionCount];
+        const size_t start = dbSize * thread_idx / threads;
+        const size_t end = dbSize * (thread_idx + 1) / threads;
+        for (size_t id = start; id < end; id++) {
+            // -2 dont read \n and \0
+            readHashes[id] = hashCanonical(seqDb.getData(id), seqDb.getSeqLens(id) - 2);
+            counts[readHashes[id] >> (64 - PARTITION_BITS)]++;
+        }
+    }
+
+    // partitions are stored one after the other, within a partition the threads in order
+    std::vector<size_t> partitionStart(partitionCount + 1, 0);
+    size_t offset = 0;
+    for (size_t partition = 0; partition < partitionCount; partition++) {
+        partitionStart[partition] = offset;
+        for (unsigned int thread = 0; thread < threads; thread++) {
+            const size_t count = partitionOffsets[thread * partitionCount + partition];
+            partitionOffsets[thread * partitionCount + partition] = offset;
+            offset += count;
+        }
+    }
+    partitionStart[partitionCount] = offset;
+
+    std::vector<ReadHash> hashes(dbSize);
+#pragma omp parallel num_threads(threads)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        size_t *offsets = &partitionOffsets[thread_idx * partitionCount];
+        const size_t start = dbSize * thread_idx / threads;
+        const size_t end = dbSize * (thread_idx + 1) / threads;
+        for (size_t id = start; id < end; id++) {
+            ReadHash &entry = hashes[offsets[readHashes[id] >> (64 - PARTITION_BITS)]++];
+            entry.hash = readHashes[id];
+            entry.length = static_cast<unsigned int>(seqDb.getSeqLens(id) - 2);
+            entry.id = id;
+        }
+    }
+    std::vector<uint64_t>().swap(readHashes);
+
+    // multiplicity[id] is the number of copies if id is the first read of its sequence, 0 otherwise
+    std::vector<unsigned int> multiplicity(dbSize, 0);
+#pragma omp parallel
+    {
+        std::vector<size_t> representatives;
+        // every partition is sorted and resolved on its own
+#pragma omp for schedule(dynamic, 1)
+        for (size_t partition = 0; partition < partitionCount; partition++) {
+            const size_t end = partitionStart[partition + 1];
+            std::sort(hashes.begin() + partitionStart[partition], hashes.begin() + end);
+            for (size_t i = partitionStart[partition]; i < end;) {
+                // within a group ids are sorted, so the lowest id becomes the representative,
+                // hash collisions are separated by comparing the sequences
+                representatives.clear();
+                size_t j = i;
+                for (; j < end && hashes[j].hash == hashes[i].hash && hashes[j].length == hashes[i].length; j++) {
+                    const size_t id = hashes[j].id;
+                    bool found = false;
+                    for (size_t k = 0; k < representatives.size(); k++) {
+                        if (sameCanonical(seqDb.getData(representatives[k]), seqDb.getData(id), hashes[j].length)) {
+                            multiplicity[representatives[k]]++;
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (found == false) {
+                        representatives.push_back(id);
+                        multiplicity[id] = 1;
+                    }
+                }
+                i = j;
+            }
+        }
+    }
+    std::vector<ReadHash>().swap(hashes);
+
+    DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads));
+    dbw.open();
+    std::string outHeaderDbName = par.db2 + "_h";
+    DBWriter headerDbw(outHeaderDbName.c_str(), (outHeaderDbName + ".index").c_str(), static_cast<unsigned int>(par.threads));
+    headerDbw.open();
+    std::string multiplicityDbName = par.db2 + "_multiplicity";
+    DBWriter multiplicityDbw(multiplicityDbName.c_str(), (multiplicityDbName + ".index").c_str(), static_cast<unsigned int>(par.threads));
+    multiplicityDbw.open();
+
+    size_t uniqueReads = 0;
+#pragma omp parallel reduction(+:uniqueReads)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        char buffer[32];
+
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < dbSize; id++) {
+            if (multiplicity[id] == 0) {
+                continue;
+            }
+            uniqueReads++;
+            // read keys are kept, so headers and other databases keyed by read still match
+            const unsigned int dbKey = seqDb.getDbKey(id);
+            dbw.writeData(seqDb.getData(id), seqDb.getSeqLens(id) - 1, dbKey, thread_idx);
+
+            const size_t headerId = headerDb.getId(dbKey);
+            if (headerId == UINT_MAX) {
+                Debug(Debug::ERROR) << "Missing header for read " << dbKey << ".\n";
+                EXIT(EXIT_FAILURE);
+            }
+            headerDbw.writeData(headerDb.getData(headerId), headerDb.getSeqLens(headerId) - 1, dbKey, thread_idx);
+
+            const int len = snprintf(buffer, sizeof(buffer), "%u\n", multiplicity[id]);
+            multiplicityDbw.writeData(buffer, len, dbKey, thread_idx);
+        }
+    }
+
+    multiplicityDbw.close();
+    headerDbw.close();
+    dbw.close(Sequence::NUCLEOTIDES);
+    headerDb.close();
+    seqDb.close();
+
+    Debug(Debug::INFO) << "Unique reads: " << uniqueReads << " of " << dbSize << "\n";
+
+    return EXIT_SUCCESS;
+}
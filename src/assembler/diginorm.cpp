@@ -0,0 +1,229 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Sequence.h"
+#include "Debug.h"
+#include "Util.h"
+#include "LocalParameters.h"
+
+#include <algorithm>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// number of hash rows of the count-min sketch
+static const size_t SKETCH_DEPTH = 4;
+// counters stop growing here, far above any useful coverage and far below overflow
+static const uint16_t SKETCH_SATURATION = 60000;
+// reads that are prefiltered in parallel against the same sketch state
+static const size_t DIGINORM_ROUND_SIZE = 16384;
+
+static inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Count-min sketch over canonical k-mers with a bounded number of 16 bit counters
+class KmerSketch {
+public:
+    KmerSketch(size_t memoryBytes) {
+        size_t width = 1;
+        while (width * 2 * SKETCH_DEPTH * sizeof(uint16_t) <= memoryBytes) {
+            width *= 2;
+        }
+        mask = width - 1;
+        counters = new uint16_t[width * SKETCH_DEPTH];
+        std::fill(counters, counters + width * SKETCH_DEPTH, 0);
+    }
+
+    ~KmerSketch() {
+        delete [] counters;
+    }
+
+    uint16_t count(uint64_t kmer) const {
+        uint16_t minCount = SKETCH_SATURATION;
+        for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+            minCount = std::min(minCount, counters[slot(kmer, row)]);
+        }
+        return minCount;
+    }
+
+    void add(uint64_t kmer) {
+        for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+            uint16_t *counter = &counters[slot(kmer, row)];
+            if (*counter < SKETCH_SATURATION) {
+                (*counter)++;
+            }
+        }
+    }
+
+    size_t getWidth() const {
+        return mask + 1;
+    }
+
+private:
+    size_t mask;
+    uint16_t *counters;
+
+    size_t slot(uint64_t kmer, size_t row) const {
+        return row * (mask + 1) + (mixHash(kmer + row * 0x9e3779b97f4a7c15ULL) & mask);
+    }
+
+    KmerSketch(const KmerSketch&);
+    KmerSketch& operator=(const KmerSketch&);
+};
+
+static inline int baseCode(char c) {
+    switch (c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+    }
+}
+
+// true if the median count of the k-mers is below the coverage, reads without k-mers carry
+// no coverage information and are kept
+static bool isBelowCoverage(const KmerSketch &sketch, const std::vector<uint64_t> &kmers,
+                            std::vector<uint16_t> &counts, uint16_t coverage) {
+    if (kmers.empty()) {
+        return true;
+    }
+    counts.resize(kmers.size());
+    for (size_t i = 0; i < kmers.size(); i++) {
+        counts[i] = sketch.count(kmers[i]);
+    }
+    std::nth_element(counts.begin(), counts.begin() + counts.size() / 2, counts.end());
+    return counts[counts.size() / 2] < coverage;
+}
+
+// Collects the canonical 2 bit encoded k-mers of a read, k-mers with other bases than ACGT are skipped
+static void extractKmers(const char *seq, size_t len, unsigned int k, std::vector<uint64_t> &kmers) {
+    kmers.clear();
+    const uint64_t kmerMask = (k == 32) ? UINT64_MAX : ((1ULL << (2 * k)) - 1);
+    const unsigned int revShift = 2 * (k - 1);
+    uint64_t forward = 0;
+    uint64_t reverse = 0;
+    unsigned int valid = 0;
+    for (size_t i = 0; i < len; i++) {
+        const int code = baseCode(seq[i]);
+        if (code < 0) {
+            valid = 0;
+            continue;
+        }
+        forward = ((forward << 2) | static_cast<uint64_t>(code)) & kmerMask;
+        reverse = (reverse >> 2) | (static_cast<uint64_t>(3 - code) << revShift);
+        if (++valid >= k) {
+            kmers.push_back(std::min(forward, reverse));
+        }
+    }
+}
+
+int diginorm(int argc, const char **argv, const Command& command) {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, 2);
+
+    if (par.diginormCoverage <= 0) {
+        Debug(Debug::ERROR) << "Target coverage has to be larger than 0.\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    Debug(Debug::INFO) << "Sequence database: " << par.db1 << "\n";
+    DBReader<unsigned int> seqDb(par.db1.c_str(), par.db1Index.c_str());
+    seqDb.open(DBReader<unsigned int>::NOSORT);
+
+    std::string headerDbName = par.db1 + "_h";
+    DBReader<unsigned int> headerDb(headerDbName.c_str(), (headerDbName + ".index").c_str());
+    headerDb.open(DBReader<unsigned int>::NOSORT);
+
+    Debug(Debug::INFO) << "Output  file: " << par.db2 << "\n";
+    DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads));
+    dbw.open();
+    std::string outHeaderDbName = par.db2 + "_h";
+    DBWriter headerDbw(outHeaderDbName.c_str(), (outHeaderDbName + ".index").c_str(), static_cast<unsigned int>(par.threads));
+    headerDbw.open();
+
+    KmerSketch sketch(static_cast<size_t>(par.diginormMemory) * 1024 * 1024);
+    Debug(Debug::INFO) << "Count-min sketch: " << SKETCH_DEPTH << " x " << sketch.getWidth() << " counters\n";
+
+    const unsigned int k = static_cast<unsigned int>(par.diginormKmer);
+    const uint16_t coverage = static_cast<uint16_t>(std::min(par.diginormCoverage, static_cast<int>(SKETCH_SATURATION)));
+    const size_t dbSize = seqDb.getSize();
+    std::vector<unsigned char> keep(std::min(dbSize, DIGINORM_ROUND_SIZE));
+    size_t keptReads = 0;
+
+    // The result is the same as deciding read by read in database order. Sketch counts only grow,
+    // so a read that is covered at the start of a round is covered at its turn as well. Every round
+    // rejects these reads in parallel, then the remaining candidates are decided in order against
+    // the sketch with the k-mers of the reads kept before them, and at last the kept reads are written.
+    std::vector<uint64_t> kmers;
+    std::vector<uint16_t> counts;
+    for (size_t start = 0; start < dbSize; start += DIGINORM_ROUND_SIZE) {
+        const size_t end = std::min(dbSize, start + DIGINORM_ROUND_SIZE);
+#pragma omp parallel
+        {
+            std::vector<uint64_t> threadKmers;
+            std::vector<uint16_t> threadCounts;
+#pragma omp for schedule(dynamic, 256)
+            for (size_t id = start; id < end; id++) {
+                // -2 dont read \n and \0
+                extractKmers(seqDb.getData(id), seqDb.getSeqLens(id) - 2, k, threadKmers);
+                keep[id - start] = isBelowCoverage(sketch, threadKmers, threadCounts, coverage);
+            }
+        }
+
+        bool sketchChanged = false;
+        for (size_t id = start; id < end; id++) {
+            if (keep[id - start] == false) {
+                continue;
+            }
+            extractKmers(seqDb.getData(id), seqDb.getSeqLens(id) - 2, k, kmers);
+            if (sketchChanged && isBelowCoverage(sketch, kmers, counts, coverage) == false) {
+                keep[id - start] = false;
+                continue;
+            }
+            for (size_t i = 0; i < kmers.size(); i++) {
+                sketch.add(kmers[i]);
+            }
+            sketchChanged = sketchChanged || kmers.empty() == false;
+        }
+
+#pragma omp parallel reduction(+:keptReads)
+        {
+            unsigned int thread_idx = 0;
+#ifdef OPENMP
+            thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+#pragma omp for schedule(dynamic, 256)
+            for (size_t id = start; id < end; id++) {
+                if (keep[id - start] == false) {
+                    continue;
+                }
+                keptReads++;
+
+                const unsigned int dbKey = seqDb.getDbKey(id);
+                dbw.writeData(seqDb.getData(id), seqDb.getSeqLens(id) - 1, dbKey, thread_idx);
+                const size_t headerId = headerDb.getId(dbKey);
+                if (headerId == UINT_MAX) {
+                    Debug(Debug::ERROR) << "Missing header for read " << dbKey << ".\n";
+                    EXIT(EXIT_FAILURE);
+                }
+                headerDbw.writeData(headerDb.getData(headerId), headerDb.getSeqLens(headerId) - 1, dbKey, thread_idx);
+            }
+        }
+    }
+
+    headerDbw.close();
+    dbw.close(Sequence::NUCLEOTIDES);
+    headerDb.close();
+    seqDb.close();
+
+    Debug(Debug::INFO) << "Kept reads: " << keptReads << " of " << dbSize << "\n";
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,4 @@
 #include "ReducedMatrix.h"
-#include "Indexer.h"
 #include "Sequence.h"
 #include "SubstitutionMatrix.h"
 
@@ -8,14 +7,63 @@
 #include "DBWriter.h"
 
 #include "LocalParameters.h"
+#include "CodingFeatureExtractor.h"
+#include "CodingModel.h"
 
 #include "kerasify/keras_model.h"
-#include "predict_coding_acc9260_56x96.model.h"
+#include "predict_coding_acc9260_56x96.model.static.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
+// the first stages are the ones of codingPrefilterStage
+enum CascadeStage {
+    STAGE_MODEL = PREFILTER_PASS,
+    STAGE_UNEXTENDED = PREFILTER_STAGE_COUNT,
+    STAGE_COUNT
+};
+
+// an assembled sequence was extended if it is longer than its entry in extendedFromDb
+static bool wasExtended(DBReader<unsigned int> &seqDb, size_t id, DBReader<unsigned int> *extendedFromDb) {
+    if (extendedFromDb == NULL) {
+        return true;
+    }
+    size_t extendedFromId = extendedFromDb->getId(seqDb.getDbKey(id));
+    return extendedFromId != UINT_MAX && seqDb.getSeqLens(id) > extendedFromDb->getSeqLens(extendedFromId);
+}
+
+// Binary sidecar with one (unsigned int key, float score) record per sequence in index order.
+// Sequences that were not extended are skipped, the score of prefilter rejections is NaN.
+static void writeScores(const std::string &fileName, DBReader<unsigned int> &seqDb,
+                        DBReader<unsigned int> *extendedFromDb, const float *scores) {
+    FILE *file = fopen(fileName.c_str(), "wb");
+    if (file == NULL) {
+        Debug(Debug::ERROR) << "Could not open " << fileName << " for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+    for (size_t id = 0; id < seqDb.getSize(); id++) {
+        if (wasExtended(seqDb, id, extendedFromDb) == false) {
+            continue;
+        }
+        unsigned int dbKey = seqDb.getDbKey(id);
+        if (fwrite(&dbKey, sizeof(unsigned int), 1, file) != 1 || fwrite(&scores[id], sizeof(float), 1, file) != 1) {
+            Debug(Debug::ERROR) << "Could not write to " << fileName << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    if (fclose(file) != 0) {
+        Debug(Debug::ERROR) << "Could not close " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
 int filternoncoding(int argc, const char **argv, const Command& command)  {
     LocalParameters& par = LocalParameters::getLocalInstance();
     par.parseParameters(argc, argv, command, 2);
@@ -29,91 +77,119 @@ int filternoncoding(int argc, const char **argv, const Command& command)  {
     DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads));
     dbw.open();
 
-    // Initialize model.
-    KerasModel model;
-    model.LoadModel(std::string((const char *)predict_coding_acc9260_56x96_model, predict_coding_acc9260_56x96_model_len));
+    // sequences that did not get longer than in this database are dropped
+    DBReader<unsigned int> *extendedFromDb = NULL;
+    if (par.extendedFrom.empty() == false) {
+        Debug(Debug::INFO) << "Keep only sequences extended from: " << par.extendedFrom << "\n";
+        extendedFromDb = new DBReader<unsigned int>(par.extendedFrom.c_str(), (par.extendedFrom + ".index").c_str(),
+                                                    DBReader<unsigned int>::USE_INDEX);
+        extendedFromDb->open(DBReader<unsigned int>::NOSORT);
+    }
+
+    // raw scores by id for the sidecar, sequences rejected before the coding model are NaN
+    // so that no threshold accepts them when it is applied to the sidecar again
+    float *scores = NULL;
+    if (par.codingScores.empty() == false) {
+        scores = new float[seqDb.getSize()];
+        std::fill(scores, scores + seqDb.getSize(), std::numeric_limits<float>::quiet_NaN());
+    }
 
     SubstitutionMatrix subMat("blosum62.out", 2.0, 0.0);
     ReducedMatrix redMat(subMat.probMatrix, subMat.subMatrixPseudoCounts, 7, subMat.getBitFactor());
 
-    // Create a 1D Tensor on length 20 for input data.
+    // Initialize model.
+    // The embedded model is compiled into a specialized forward pass,
+    // other models and the int8 mode use the runtime loader
+    const bool useEmbeddedModel = par.codingModel.empty() && par.codingInt8 == 0;
+    KerasModel model;
+    if (useEmbeddedModel) {
+        if (CodingFeatureExtractor(subMat, redMat).getFeatureCount() != predict_coding_acc9260_56x96_model_static::kInputSize) {
+            Debug(Debug::ERROR) << "Features do not match the input of the embedded coding model.\n";
+            EXIT(EXIT_FAILURE);
+        }
+    } else {
+        loadCodingModel(model, par.codingModel);
+        if (par.codingInt8 == 1 && model.Quantize() == false) {
+            Debug(Debug::ERROR) << "Could not quantize coding model.\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+
+    size_t stageCount[STAGE_COUNT] = {};
 #pragma omp parallel
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
         thread_idx = static_cast<unsigned int>(omp_get_thread_num());
 #endif
-
-        Tensor in(56);
-        float counter[255];
-        std::fill(counter, counter + 255, 1.0);
-        Sequence seq(par.maxSeqLen, Sequence::AMINO_ACIDS, &subMat,  par.kmerSize, false, false);
-        Sequence rseq(par.maxSeqLen, Sequence::AMINO_ACIDS, &redMat, 2, false, false);
-        Indexer indexer(redMat.alphabetSize, 2);
-        float *diAACnt = new float[redMat.alphabetSize * redMat.alphabetSize];
-        std::fill(diAACnt, diAACnt + redMat.alphabetSize * redMat.alphabetSize, 1.0);
+        CodingFeatureExtractor extractor(subMat, redMat);
+        // the features are written directly into the input row of the model
+        Tensor in(static_cast<int>(extractor.getFeatureCount()));
+        Tensor out;
+        // the model is shared, all scratch memory of the forward pass is owned by the thread
+        KerasContext context(model);
+        size_t threadStageCount[STAGE_COUNT] = {};
 
 #pragma omp for schedule(static)
         for (size_t id = 0; id < seqDb.getSize(); id++) {
-            std::vector<float> data;
             char *seqData = seqDb.getData(id);
             unsigned int dbKey = seqDb.getDbKey(id);
-            seq.mapSequence(id, dbKey, seqData);
-
-            //printf("%5d ", seq.L);
-            float totalAACnt = 0;
-            for (int pos = 0; pos < seq.L; pos++) {
-                if (seq.int_sequence[pos] < subMat.alphabetSize - 1) {
-                    counter[seq.int_sequence[pos]] += 1.0;
-                    totalAACnt += 1.0;
+            // -1 dont read \0 byte
+            size_t seqLen = seqDb.getSeqLens(id) - 1;
+            size_t stage = STAGE_MODEL;
+            float score = 0.0f;
+            if (wasExtended(seqDb, id, extendedFromDb) == false) {
+                stage = STAGE_UNEXTENDED;
+            } else {
+                const size_t aaCount = extractor.extract(seqData, seqLen, in.data_.data());
+                if (par.codingPrefilter == 1) {
+                    stage = codingPrefilterStage(seqData, seqLen, extractor, aaCount, subMat.alphabetSize);
                 }
-            }
-            for (int aa = 0; aa < subMat.alphabetSize - 1; aa++) {
-                data.push_back(counter[aa] / (totalAACnt + subMat.alphabetSize - 1));
-                counter[aa] = 1.0;
-                //printf("%.4f ", data.back());
-            }
-
-            rseq.mapSequence(id, dbKey, seqData);
-            float totalDiAACnt = 0;
-            while (rseq.hasNextKmer()) {
-                const int *kmer = rseq.nextKmer();
-                // ignore x
-                if (kmer[0] == redMat.alphabetSize - 1 || kmer[1] == redMat.alphabetSize - 1) {
-                    continue;
+                if (stage == STAGE_MODEL) {
+                    if (useEmbeddedModel) {
+                        predict_coding_acc9260_56x96_model_static::Apply(in.data_.data(), &score);
+                    } else {
+                        model.Apply(&in, &out, &context);
+                        score = out.data_[0];
+                    }
                 }
-                size_t index = indexer.int2index(kmer);
-                diAACnt[index] += 1.0;
-                totalDiAACnt += 1.0;
             }
-            size_t kmer[2];
-            for (int raa = 0; raa < (redMat.alphabetSize * redMat.alphabetSize); raa++) {
-                indexer.index2int(kmer, raa, 2);
-                if (kmer[0] == redMat.alphabetSize - 1 || kmer[1] == redMat.alphabetSize - 1) {
-                    continue;
-                }
-                data.push_back(diAACnt[raa] / (totalDiAACnt + (redMat.alphabetSize - 1) * (redMat.alphabetSize - 1)));
-                //printf("%.4f ", data.back());
-                diAACnt[raa] = 1.0;
+            threadStageCount[stage]++;
+            if (scores != NULL && stage == STAGE_MODEL) {
+                scores[id] = score;
             }
-            //printf("\n");
-            //printf("%d\n", data.size());
-            in.data_ = data;
-            // Run prediction.
-            Tensor out;
-            model.Apply(&in, &out);
-            if (out.data_[0] > 0.2) {
-                // -1 dont write \0 byte
-                dbw.writeData(seqData, seqDb.getSeqLens(id) - 1, dbKey, thread_idx);
-            } else {
-                dbw.writeData("\n",  1, dbKey, thread_idx);
+
+            if (stage == STAGE_MODEL && score > par.codingThreshold) {
+                dbw.writeData(seqData, seqLen, dbKey, thread_idx);
             }
-//        out.Print();
         }
 
-        delete[] diAACnt;
+#pragma omp critical
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            stageCount[i] += threadStageCount[i];
+        }
+    }
+
+    if (scores != NULL) {
+        writeScores(par.codingScores, seqDb, extendedFromDb, scores);
+        delete [] scores;
+    }
+    if (extendedFromDb != NULL) {
+        extendedFromDb->close();
+        delete extendedFromDb;
+    }
+
+    const float total = std::max(static_cast<float>(seqDb.getSize()), 1.0f);
+    if (par.extendedFrom.empty() == false) {
+        Debug(Debug::INFO) << "Not extended:               " << stageCount[STAGE_UNEXTENDED] / total << "\n";
+    }
+    if (par.codingPrefilter == 1) {
+        for (int stage = PREFILTER_PASS + 1; stage < PREFILTER_STAGE_COUNT; stage++) {
+            Debug(Debug::INFO) << "Rejected by " << codingPrefilterStageName(static_cast<CodingPrefilterStage>(stage))
+                               << ": " << stageCount[stage] / total << "\n";
+        }
     }
-//    std::cout << "Filtered: " << static_cast<float>(cnt)/ static_cast<float>(seqDb.getSize()) << std::endl;
+    Debug(Debug::INFO) << "Predicted by coding model:  " << stageCount[STAGE_MODEL] / total << "\n";
     dbw.close(Sequence::AMINO_ACIDS);
     seqDb.close();
 
@@ -0,0 +1,212 @@
+#include "ReducedMatrix.h"
+#include "SubstitutionMatrix.h"
+
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Sequence.h"
+#include "Debug.h"
+#include "Util.h"
+#include "LocalParameters.h"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+static inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Two blocked Bloom filters, one for k-mers that were seen and one for k-mers that were seen
+// at least twice. All bits of a k-mer are in one word, so a single atomic or decides whether an
+// insertion was the first one. Concurrent insertions can thus only produce false positives.
+class SolidKmerFilter {
+public:
+    SolidKmerFilter(size_t memoryBytes) {
+        size_t words = 1;
+        while (words * 2 * 2 * sizeof(uint64_t) <= memoryBytes) {
+            words *= 2;
+        }
+        mask = words - 1;
+        seen = new uint64_t[words];
+        solid = new uint64_t[words];
+        std::fill(seen, seen + words, 0);
+        std::fill(solid, solid + words, 0);
+    }
+
+    ~SolidKmerFilter() {
+        delete [] seen;
+        delete [] solid;
+    }
+
+    // may be called concurrently
+    void add(uint64_t kmer) {
+        const uint64_t hash = mixHash(kmer);
+        const size_t word = hash & mask;
+        const uint64_t bits = blockBits(hash);
+        const uint64_t before = __sync_fetch_and_or(&seen[word], bits);
+        if ((before & bits) == bits && (solid[word] & bits) != bits) {
+            __sync_fetch_and_or(&solid[word], bits);
+        }
+    }
+
+    bool isSolid(uint64_t kmer) const {
+        const uint64_t hash = mixHash(kmer);
+        const uint64_t bits = blockBits(hash);
+        return (solid[hash & mask] & bits) == bits;
+    }
+
+    size_t getMemory() const {
+        return (mask + 1) * 2 * sizeof(uint64_t);
+    }
+
+private:
+    size_t mask;
+    uint64_t *seen;
+    uint64_t *solid;
+
+    // four bits within the word, taken from the hash bits that do not select the word
+    static uint64_t blockBits(uint64_t hash) {
+        return (1ULL << ((hash >> 40) & 63)) | (1ULL << ((hash >> 46) & 63))
+               | (1ULL << ((hash >> 52) & 63)) | (1ULL << ((hash >> 58) & 63));
+    }
+
+    SolidKmerFilter(const SolidKmerFilter&);
+    SolidKmerFilter& operator=(const SolidKmerFilter&);
+};
+
+// Maps a sequence to the alphabet kmermatcher uses, everything unknown becomes X
+static void mapSequence(const BaseMatrix &subMat, const char *seq, size_t len, std::vector<unsigned char> &mapped) {
+    mapped.resize(len);
+    const int xIndex = subMat.alphabetSize - 1;
+    for (size_t i = 0; i < len; i++) {
+        int aa = subMat.aa2int[toupper(static_cast<unsigned char>(seq[i]))];
+        if (aa < 0 || aa > xIndex) {
+            aa = xIndex;
+        }
+        mapped[i] = static_cast<unsigned char>(aa);
+    }
+}
+
+// Calls fn with every k-mer of the mapped sequence as polynomial in the alphabet size,
+// longer k-mers wrap around 64 bits which only merges some of them.
+// Stops and returns true as soon as fn returns true.
+template <typename Fn>
+static bool forEachKmer(const std::vector<unsigned char> &mapped, unsigned int k, uint64_t alphabetSize, Fn fn) {
+    if (mapped.size() < k) {
+        return false;
+    }
+    uint64_t leadingWeight = 1;
+    for (unsigned int i = 0; i < k; i++) {
+        leadingWeight *= alphabetSize;
+    }
+    uint64_t kmer = 0;
+    for (size_t i = 0; i < mapped.size(); i++) {
+        kmer = kmer * alphabetSize + mapped[i];
+        if (i >= k) {
+            kmer -= leadingWeight * mapped[i - k];
+        }
+        if (i + 1 >= k && fn(kmer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct AddKmer {
+    SolidKmerFilter &filter;
+    AddKmer(SolidKmerFilter &filter) : filter(filter) {}
+    bool operator()(uint64_t kmer) const {
+        filter.add(kmer);
+        return false;
+    }
+};
+
+struct FindSolidKmer {
+    const SolidKmerFilter &filter;
+    FindSolidKmer(const SolidKmerFilter &filter) : filter(filter) {}
+    bool operator()(uint64_t kmer) const {
+        return filter.isSolid(kmer);
+    }
+};
+
+int filtersolidkmers(int argc, const char **argv, const Command& command) {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, 2);
+
+    // same alphabet as kmermatcher, a sequence without a k-mer that occurs twice cannot get a match there
+    BaseMatrix *subMat;
+    if (par.alphabetSize == 21) {
+        subMat = new SubstitutionMatrix(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+    } else {
+        SubstitutionMatrix sMat(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+        subMat = new ReducedMatrix(sMat.probMatrix, sMat.subMatrixPseudoCounts, par.alphabetSize, 2.0);
+    }
+    const unsigned int k = static_cast<unsigned int>(par.kmerSize);
+    const uint64_t alphabetSize = static_cast<uint64_t>(subMat->alphabetSize);
+
+    Debug(Debug::INFO) << "Sequence database: " << par.db1 << "\n";
+    DBReader<unsigned int> seqDb(par.db1.c_str(), par.db1Index.c_str());
+    seqDb.open(DBReader<unsigned int>::NOSORT);
+
+    SolidKmerFilter filter(static_cast<size_t>(par.solidKmerMemory) * 1024 * 1024);
+    Debug(Debug::INFO) << "Solid k-mer filter: " << filter.getMemory() / (1024 * 1024) << " MB\n";
+
+    const size_t dbSize = seqDb.getSize();
+#pragma omp parallel
+    {
+        std::vector<unsigned char> mapped;
+#pragma omp for schedule(dynamic, 256)
+        for (size_t id = 0; id < dbSize; id++) {
+            // -2 dont read \n and \0
+            mapSequence(*subMat, seqDb.getData(id), seqDb.getSeqLens(id) - 2, mapped);
+            forEachKmer(mapped, k, alphabetSize, AddKmer(filter));
+        }
+    }
+
+    Debug(Debug::INFO) << "Output  file: " << par.db2 << "\n";
+    DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads));
+    dbw.open();
+    // the dropped sequences are kept aside, the assembly takes them up again later
+    std::string droppedDbName = par.db2 + "_dropped";
+    DBWriter droppedDbw(droppedDbName.c_str(), (droppedDbName + ".index").c_str(), static_cast<unsigned int>(par.threads));
+    droppedDbw.open();
+
+    size_t keptSequences = 0;
+#pragma omp parallel reduction(+:keptSequences)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        std::vector<unsigned char> mapped;
+#pragma omp for schedule(dynamic, 256)
+        for (size_t id = 0; id < dbSize; id++) {
+            const char *seqData = seqDb.getData(id);
+            mapSequence(*subMat, seqData, seqDb.getSeqLens(id) - 2, mapped);
+            // keys are kept, so the headers of the input still belong to both outputs
+            if (forEachKmer(mapped, k, alphabetSize, FindSolidKmer(filter)) == false) {
+                droppedDbw.writeData(seqData, seqDb.getSeqLens(id) - 1, seqDb.getDbKey(id), thread_idx);
+                continue;
+            }
+            keptSequences++;
+            dbw.writeData(seqData, seqDb.getSeqLens(id) - 1, seqDb.getDbKey(id), thread_idx);
+        }
+    }
+
+    droppedDbw.close(Sequence::AMINO_ACIDS);
+    dbw.close(Sequence::AMINO_ACIDS);
+    seqDb.close();
+    delete subMat;
+
+    Debug(Debug::INFO) << "Sequences with a solid k-mer: " << keptSequences << " of " << dbSize << "\n";
+
+    return EXIT_SUCCESS;
+}
@@ -8,11 +8,193 @@
 #include "Debug.h"
 #include "Util.h"
 #include "LocalParameters.h"
+#include "ReadTrimmer.h"
+#include "KSeqBgzf.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
+// number of read pairs that are read, merged and written at once
+static const size_t MERGE_BATCH_SIZE = 16384;
+// number of read pairs a thread passes to combine_reads_batch at once,
+// pairs of equal read lengths within are aligned together
+static const size_t MERGE_CHUNK_SIZE = 256;
+
+struct ReadPair {
+    std::string name1;
+    std::string seq1;
+    std::string qual1;
+    std::string name2;
+    std::string seq2;
+    std::string qual2;
+
+    enum combine_status status;
+    std::string combined;
+};
+
+struct ReadPairBatch {
+    ReadPairBatch() : size(0), pairs(MERGE_BATCH_SIZE) {}
+
+    size_t size;
+    std::vector<ReadPair> pairs;
+};
+
+// Reads up to MERGE_BATCH_SIZE entries of one mate file into the batch
+static size_t readMates(KSeqWrapper *kseq, ReadPairBatch &batch, bool firstMate) {
+    size_t count = 0;
+    while (count < MERGE_BATCH_SIZE && kseq->ReadEntry()) {
+        const KSeqWrapper::KSeqEntry &entry = kseq->entry;
+        ReadPair &pair = batch.pairs[count];
+        std::string &name = firstMate ? pair.name1 : pair.name2;
+        std::string &seq = firstMate ? pair.seq1 : pair.seq2;
+        std::string &qual = firstMate ? pair.qual1 : pair.qual2;
+        name.assign(entry.name.s, entry.name.l);
+        seq.assign(entry.sequence.s, entry.sequence.l);
+        qual.assign(entry.qual.s != NULL ? entry.qual.s : "", entry.qual.l);
+        count++;
+    }
+    return count;
+}
+
+// Combined reads are reserved for this many bases up front, longer merges grow them once
+static const size_t MERGE_RESERVE_LENGTH = 512;
+
+// Per thread read structs for combine_reads_batch. The mate reads only point into the
+// batch strings, the combined reads own their buffers for the lifetime of the pool.
+class ReadBufferPool {
+public:
+    ReadBufferPool(size_t threads, size_t count, size_t reserveLength) : count(count), reads(threads * 3 * count) {
+        memset(reads.data(), 0, reads.size() * sizeof(struct read));
+        for (size_t thread = 0; thread < threads; thread++) {
+            struct read *combined = getCombined(thread);
+            for (size_t i = 0; i < count; i++) {
+                read_reserve(&combined[i], reserveLength);
+            }
+        }
+    }
+
+    ~ReadBufferPool() {
+        for (size_t thread = 0; thread < reads.size() / (3 * count); thread++) {
+            struct read *combined = getCombined(thread);
+            for (size_t i = 0; i < count; i++) {
+                read_free_buffers(&combined[i]);
+            }
+        }
+    }
+
+    struct read *getMates1(size_t thread) {
+        return &reads[thread * 3 * count];
+    }
+
+    struct read *getMates2(size_t thread) {
+        return &reads[(thread * 3 + 1) * count];
+    }
+
+    struct read *getCombined(size_t thread) {
+        return &reads[(thread * 3 + 2) * count];
+    }
+
+private:
+    size_t count;
+    std::vector<struct read> reads;
+
+    ReadBufferPool(const ReadBufferPool&);
+    ReadBufferPool& operator=(const ReadBufferPool&);
+};
+
+// Cuts low quality tails and adapters, FASTA reads without qualities are only clipped at adapters
+static void trimRead(const ReadTrimmer &trimmer, std::string &seq, std::string &qual) {
+    const bool hasQual = qual.size() >= seq.size() && seq.empty() == false;
+    const size_t len = trimmer.trimmedLength(seq.c_str(), hasQual ? qual.c_str() : NULL, seq.size());
+    seq.resize(len);
+}
+
+static void trimSingles(ReadPair *pairs, size_t count, const ReadTrimmer &trimmer) {
+    for (size_t i = 0; i < count; i++) {
+        if (trimmer.isEnabled()) {
+            trimRead(trimmer, pairs[i].seq1, pairs[i].qual1);
+        }
+        pairs[i].status = NOT_COMBINED;
+    }
+}
+
+// Merges count pairs with combine_reads_batch, r1, r2 and combined hold count reads each.
+// Both mates are trimmed before merging, so merged and unmerged reads lose their bad tails alike.
+static void mergePairs(ReadPair *pairs, size_t count, struct read *r1, struct read *r2, struct read *combined,
+                       enum combine_status *status, const combine_params &params, const ReadTrimmer &trimmer) {
+    for (size_t i = 0; i < count; i++) {
+        ReadPair &pair = pairs[i];
+        if (trimmer.isEnabled()) {
+            trimRead(trimmer, pair.seq1, pair.qual1);
+            trimRead(trimmer, pair.seq2, pair.qual2);
+        }
+        // FASTA input has no qualities, combine_reads expects one per base
+        pair.qual1.resize(pair.seq1.size(), '\0');
+        pair.qual2.resize(pair.seq2.size(), '\0');
+
+        r1[i].seq = &pair.seq1[0];
+        r1[i].seq_len = static_cast<int>(pair.seq1.size());
+        r1[i].qual = &pair.qual1[0];
+        r1[i].qual_len = static_cast<int>(pair.qual1.size());
+
+        r2[i].seq = &pair.seq2[0];
+        r2[i].seq_len = static_cast<int>(pair.seq2.size());
+        r2[i].qual = &pair.qual2[0];
+        r2[i].qual_len = static_cast<int>(pair.qual2.size());
+        reverse_complement(&r2[i]);
+    }
+
+    combine_reads_batch(r1, r2, combined, status, static_cast<int>(count), &params);
+
+    for (size_t i = 0; i < count; i++) {
+        pairs[i].status = status[i];
+        if (status[i] != NOT_COMBINED) {
+            pairs[i].combined.assign(combined[i].seq, combined[i].seq_len);
+        }
+    }
+}
+
+static void writeSequence(DBWriter &resultWriter, DBWriter &headerResultWriter, const std::string &seq,
+                          const std::string &name, unsigned int id) {
+    char newLine = '\n';
+    resultWriter.writeStart(0);
+    resultWriter.writeAdd(seq.c_str(), seq.size(), 0);
+    resultWriter.writeAdd(&newLine, 1, 0);
+    resultWriter.writeEnd(id, 0, true);
+    headerResultWriter.writeData(name.c_str(), name.size(), id, 0, true);
+}
+
+// Keys are assigned in input order, as a single thread would do.
+// Reads that were trimmed away completely are not written.
+static void writeBatch(DBWriter &resultWriter, DBWriter &headerResultWriter, const ReadPairBatch &batch,
+                       unsigned int &id) {
+    for (size_t i = 0; i < batch.size; i++) {
+        const ReadPair &pair = batch.pairs[i];
+        switch (pair.status) {
+            case COMBINED_AS_INNIE:
+            case COMBINED_AS_OUTIE:
+                writeSequence(resultWriter, headerResultWriter, pair.combined, pair.name1, id);
+                id++;
+                break;
+            case NOT_COMBINED:
+                if (pair.seq1.empty() == false) {
+                    writeSequence(resultWriter, headerResultWriter, pair.seq1, pair.name1, id);
+                    id++;
+                }
+                // the second read stays reverse complemented, single-end input has none
+                if (pair.seq2.empty() == false) {
+                    writeSequence(resultWriter, headerResultWriter, pair.seq2, pair.name2, id);
+                    id++;
+                }
+                break;
+        }
+    }
+}
 
 int mergereads(int argn, const char **argv, const Command& command) {
     LocalParameters& par = LocalParameters::getLocalInstance();
@@ -29,79 +211,111 @@ int mergereads(int argn, const char **argv, const Command& command) {
     alg_params.max_mismatch_density = 0.25;
     alg_params.cap_mismatch_quals = false;
     alg_params.allow_outies = false;
+    alg_params.seed_kmer_len = par.mergeSeedKmer;
+
+    ReadTrimmer trimmer(par.trimQuality, par.trimWindow, par.adapters);
 
     std::vector<std::string> filenames(par.filenames);
+    // a single input file is trimmed without merging
+    const bool singleEnd = filenames.size() == 2;
+    if (singleEnd == false && (filenames.size() - 1) % 2 != 0) {
+        Debug(Debug::ERROR) << "Paired-end input needs two files per read set.\n";
+        EXIT(EXIT_FAILURE);
+    }
     std::string outFile = par.filenames.back();
     std::string outIndexFile = outFile + ".index";
     DBWriter resultWriter(outFile.c_str(), outIndexFile.c_str());
     resultWriter.open();
     DBWriter headerResultWriter((outFile+"_h").c_str(), (outFile+"_h.index").c_str());
     headerResultWriter.open();
+
+    ReadBufferPool readBuffers(static_cast<size_t>(par.threads), MERGE_CHUNK_SIZE, MERGE_RESERVE_LENGTH);
+
+    // Pipeline over three batches: while the mate files of the next batch are read
+    // and the previous batch is written, all other threads merge the current batch.
+    // File pairs are streamed back to back through the same pipeline.
+    ReadPairBatch batches[3];
+    size_t prev = 0;
+    size_t cur = 1;
+    size_t next = 2;
+    size_t filePair = 0;
+    const size_t filePairs = filenames.size() / 2;
+    // blocks of BGZF input are inflated as tasks, merge threads pick them up once their chunks are done
+    const unsigned int threads = static_cast<unsigned int>(par.threads);
+    KSeqWrapper *kseq1 = NULL;
+    KSeqWrapper *kseq2 = NULL;
+    if (singleEnd) {
+        kseq1 = KSeqBgzfFactory(filenames[0].c_str(), threads);
+    } else if (filePair < filePairs) {
+        kseq1 = KSeqBgzfFactory(filenames[filePair * 2].c_str(), threads);
+        kseq2 = KSeqBgzfFactory(filenames[filePair * 2 + 1].c_str(), threads);
+    }
     unsigned int id = 0;
-    {
-        size_t readSize = sizeof(struct read);
-        struct read * r1 = (struct read *) memset(malloc(readSize), 0, readSize);
-        struct read * r2 = (struct read *) memset(malloc(readSize), 0, readSize);
-        struct read * r_combined = (struct read *) memset(malloc(readSize), 0, readSize);
-
-        for (size_t i = 0; i < filenames.size() / 2; i++) {
-            std::string splitHeader;
-            splitHeader.reserve(1024);
-            std::string header;
-            header.reserve(1024);
-            std::string splitId;
-            splitId.reserve(1024);
-            char lookupBuffer[32768];
-            KSeqWrapper *kseq1 = KSeqFactory(filenames[i * 2].c_str());
-            KSeqWrapper *kseq2 = KSeqFactory(filenames[i * 2 + 1].c_str());
-            while (kseq1->ReadEntry() && kseq2->ReadEntry()) {
-
-                const KSeqWrapper::KSeqEntry &read1 = kseq1->entry;
-                const KSeqWrapper::KSeqEntry &read2 = kseq2->entry;
-                r1->seq =  read1.sequence.s;
-                r1->seq_len = read1.sequence.l;
-                r1->qual = read1.qual.s;
-                r1->qual_len = read1.qual.l;
-
-                r2->seq = read2.sequence.s;
-                r2->seq_len = read2.sequence.l;
-                r2->qual = read2.qual.s;
-                r2->qual_len = read2.qual.l;
-                reverse_complement(r2);
-                enum combine_status status = combine_reads(r1, r2, r_combined, &alg_params);
-                char newLine = '\n';
-                switch (status) {
-                    case COMBINED_AS_INNIE:
-                    case COMBINED_AS_OUTIE:
-                        //resultWriter.writeData(r_combined->seq, r_combined->seq_len,  id);
-                        resultWriter.writeStart(0);
-                        resultWriter.writeAdd(r_combined->seq, r_combined->seq_len, 0);
-                        resultWriter.writeAdd(&newLine, 1, 0);
-                        resultWriter.writeEnd(id, 0, true);
-                        headerResultWriter.writeData(read1.name.s, read1.name.l, id, 0, true );
-                        break;
-                    case NOT_COMBINED:
-                        resultWriter.writeStart(0);
-                        resultWriter.writeAdd(r1->seq, r1->seq_len, 0);
-                        resultWriter.writeAdd(&newLine, 1, 0);
-                        resultWriter.writeEnd(id, 0, true);
-                        headerResultWriter.writeData(read1.name.s, read1.name.l, id, 0, true );
-                        id++;
-                        resultWriter.writeStart(0);
-                        resultWriter.writeAdd(r2->seq, r2->seq_len, 0);
-                        resultWriter.writeAdd(&newLine, 1, 0);
-                        resultWriter.writeEnd(id, 0, true);
-                        headerResultWriter.writeData(read2.name.s, read1.name.l, id, 0, true );
-                        break;
+    while (kseq1 != NULL || batches[cur].size > 0 || batches[prev].size > 0) {
+        size_t count1 = 0;
+        size_t count2 = 0;
+        ReadPairBatch &readBatch = batches[next];
+        ReadPairBatch &mergeBatch = batches[cur];
+        ReadPairBatch &writeBatchRef = batches[prev];
+#pragma omp parallel
+        {
+            unsigned int thread_idx = 0;
+#ifdef OPENMP
+            thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+#pragma omp single nowait
+            {
+                if (kseq1 != NULL) {
+                    count1 = readMates(kseq1, readBatch, true);
+                }
+            }
+#pragma omp single nowait
+            {
+                if (kseq2 != NULL) {
+                    count2 = readMates(kseq2, readBatch, false);
+                }
+            }
+#pragma omp single nowait
+            {
+                writeBatch(resultWriter, headerResultWriter, writeBatchRef, id);
+            }
+
+            enum combine_status status[MERGE_CHUNK_SIZE];
+#pragma omp for schedule(dynamic, 1)
+            for (size_t i = 0; i < mergeBatch.size; i += MERGE_CHUNK_SIZE) {
+                const size_t count = std::min(MERGE_CHUNK_SIZE, mergeBatch.size - i);
+                if (singleEnd) {
+                    trimSingles(&mergeBatch.pairs[i], count, trimmer);
+                } else {
+                    mergePairs(&mergeBatch.pairs[i], count,
+                               readBuffers.getMates1(thread_idx), readBuffers.getMates2(thread_idx),
+                               readBuffers.getCombined(thread_idx), status, alg_params, trimmer);
                 }
-                id++;
             }
+        }
+
+        if (singleEnd) {
+            count2 = count1;
+        }
+        // a pair ends as soon as one of its files ends
+        readBatch.size = std::min(count1, count2);
+        if (kseq1 != NULL && (count1 < MERGE_BATCH_SIZE || count2 < MERGE_BATCH_SIZE)) {
             delete kseq1;
             delete kseq2;
-            free(r1);
-            free(r2);
-            free(r_combined);
+            kseq1 = NULL;
+            kseq2 = NULL;
+            filePair++;
+            if (singleEnd == false && filePair < filePairs) {
+                kseq1 = KSeqBgzfFactory(filenames[filePair * 2].c_str(), threads);
+                kseq2 = KSeqBgzfFactory(filenames[filePair * 2 + 1].c_str(), threads);
+            }
         }
+        batches[prev].size = 0;
+
+        size_t written = prev;
+        prev = cur;
+        cur = next;
+        next = written;
     }
 
     // cleanup
@@ -111,6 +325,3 @@ int mergereads(int argn, const char **argv, const Command& command) {
 
     return EXIT_SUCCESS;
 }
-
-
-
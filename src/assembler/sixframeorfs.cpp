@@ -0,0 +1,374 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Sequence.h"
+#include "Debug.h"
+#include "Util.h"
+#include "LocalParameters.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The two ORF classes of the protein assembly, as extracted before by
+// extractorfs --orf-start-mode 0 --max-gaps 0 with
+//   start: --contig-start-mode 1 --contig-end-mode 0 --min-length 30 --max-length 45
+//   long:  --min-length 45 (and the default --max-length)
+// Lengths are in codons including the stop codon and the minimum is exclusive.
+static const size_t START_ORF_MIN_CODONS = 30;
+static const size_t START_ORF_MAX_CODONS = 45;
+static const size_t LONG_ORF_MIN_CODONS = 45;
+static const size_t LONG_ORF_MAX_CODONS = 32734;
+
+// reads per round, the ORFs of a round are kept in memory until their keys are known
+static const size_t ORF_ROUND_SIZE = 65536;
+
+// bytes behind every buffer, so that the codon scanner can load 16 codons past the end
+static const size_t SCAN_PADDING = 32;
+
+enum CodonFlag {
+    CODON_STOP = 1,
+    CODON_START = 2,
+    CODON_GAP = 4
+};
+
+// standard genetic code, bases in the order TCAG
+static const char GENETIC_CODE[] = "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG";
+
+// bit mask of the bases (T=1, C=2, A=4, G=8) a nucleotide code stands for, 0 for gaps and unknown characters
+static unsigned char baseMask[256];
+// reverse complement of a nucleotide code
+static char complementBase[256];
+
+static void initBaseTables() {
+    const char *codes      = "TCAGURYSWKMBDHVN";
+    const char *complement = "AGTCAYRSWMKVHDBN";
+    const unsigned char masks[] = {1, 2, 4, 8, 1, 4 | 8, 1 | 2, 2 | 8, 1 | 4, 1 | 8, 2 | 4, 1 | 2 | 8, 1 | 4 | 8, 1 | 2 | 4, 2 | 4 | 8, 15};
+    for (size_t i = 0; i < 256; i++) {
+        baseMask[i] = 0;
+        complementBase[i] = '.';
+    }
+    for (size_t i = 0; codes[i] != '\0'; i++) {
+        baseMask[static_cast<unsigned char>(codes[i])] = masks[i];
+        baseMask[static_cast<unsigned char>(tolower(codes[i]))] = masks[i];
+        complementBase[static_cast<unsigned char>(codes[i])] = complement[i];
+        complementBase[static_cast<unsigned char>(tolower(codes[i]))] = complement[i];
+    }
+}
+
+static inline bool isGapBase(char c) {
+    // N and everything that is no nucleotide code counts as gap, like in extractorfs
+    return c == 'N' || baseMask[static_cast<unsigned char>(c)] == 0;
+}
+
+// Upper case copy with U as T, gap[i] is 0xFF where the base is a gap
+static void normalizeSequence(const char *seq, size_t len, std::vector<char> &out, std::vector<unsigned char> &gap) {
+    out.assign(len + SCAN_PADDING, '\0');
+    gap.assign(len + SCAN_PADDING, 0);
+    for (size_t i = 0; i < len; i++) {
+        char c = static_cast<char>(toupper(static_cast<unsigned char>(seq[i])));
+        c = (c == 'U') ? 'T' : c;
+        out[i] = c;
+        gap[i] = isGapBase(c) ? 0xFF : 0;
+    }
+}
+
+static void reverseComplement(const std::vector<char> &seq, const std::vector<unsigned char> &gap, size_t len,
+                              std::vector<char> &out, std::vector<unsigned char> &outGap) {
+    out.assign(len + SCAN_PADDING, '\0');
+    outGap.assign(len + SCAN_PADDING, 0);
+    for (size_t i = 0; i < len; i++) {
+        out[len - 1 - i] = complementBase[static_cast<unsigned char>(seq[i])];
+        outGap[len - 1 - i] = gap[i];
+    }
+}
+
+static inline unsigned char codonFlags(const char *s, const unsigned char *gap) {
+    unsigned char flags = 0;
+    if (s[0] == 'T' && ((s[1] == 'A' && (s[2] == 'A' || s[2] == 'G')) || (s[1] == 'G' && s[2] == 'A'))) {
+        flags |= CODON_STOP;
+    }
+    if (s[0] == 'A' && s[1] == 'T' && s[2] == 'G') {
+        flags |= CODON_START;
+    }
+    if ((gap[0] | gap[1] | gap[2]) != 0) {
+        flags |= CODON_GAP;
+    }
+    return flags;
+}
+
+// Flags of the codon starting at every position, which covers the three frames of a strand.
+// seq and gap need SCAN_PADDING bytes behind len.
+static void scanCodons(const char *seq, const unsigned char *gap, size_t len, std::vector<unsigned char> &flags) {
+    flags.resize(len + SCAN_PADDING);
+    size_t pos = 0;
+#ifdef __SSE2__
+    const __m128i charA = _mm_set1_epi8('A');
+    const __m128i charG = _mm_set1_epi8('G');
+    const __m128i charT = _mm_set1_epi8('T');
+    const __m128i stopBit = _mm_set1_epi8(CODON_STOP);
+    const __m128i startBit = _mm_set1_epi8(CODON_START);
+    const __m128i gapBit = _mm_set1_epi8(CODON_GAP);
+    for (; pos < len; pos += 16) {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seq + pos));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seq + pos + 1));
+        const __m128i third = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seq + pos + 2));
+        // TAA, TAG and TGA
+        const __m128i secondA = _mm_cmpeq_epi8(second, charA);
+        const __m128i thirdA = _mm_cmpeq_epi8(third, charA);
+        const __m128i thirdAorG = _mm_or_si128(thirdA, _mm_cmpeq_epi8(third, charG));
+        const __m128i stop = _mm_and_si128(_mm_cmpeq_epi8(first, charT),
+                                           _mm_or_si128(_mm_and_si128(secondA, thirdAorG),
+                                                        _mm_and_si128(_mm_cmpeq_epi8(second, charG), thirdA)));
+        // ATG
+        const __m128i start = _mm_and_si128(_mm_cmpeq_epi8(first, charA),
+                                            _mm_and_si128(_mm_cmpeq_epi8(second, charT), _mm_cmpeq_epi8(third, charG)));
+        const __m128i codonGap = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(gap + pos)),
+                                              _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(gap + pos + 1)),
+                                                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(gap + pos + 2))));
+        const __m128i result = _mm_or_si128(_mm_and_si128(stop, stopBit),
+                                            _mm_or_si128(_mm_and_si128(start, startBit), _mm_and_si128(codonGap, gapBit)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&flags[pos]), result);
+    }
+#endif
+    for (; pos + 2 < len; pos++) {
+        flags[pos] = codonFlags(seq + pos, gap + pos);
+    }
+}
+
+// Translates a codon, ambiguous codes are resolved if all bases they stand for give the same amino acid
+static char translateCodon(const char *codon) {
+    const unsigned char masks[3] = {
+            baseMask[static_cast<unsigned char>(codon[0])],
+            baseMask[static_cast<unsigned char>(codon[1])],
+            baseMask[static_cast<unsigned char>(codon[2])]
+    };
+    char aa = '\0';
+    for (int b1 = 0; b1 < 4; b1++) {
+        if ((masks[0] & (1 << b1)) == 0) {
+            continue;
+        }
+        for (int b2 = 0; b2 < 4; b2++) {
+            if ((masks[1] & (1 << b2)) == 0) {
+                continue;
+            }
+            for (int b3 = 0; b3 < 4; b3++) {
+                if ((masks[2] & (1 << b3)) == 0) {
+                    continue;
+                }
+                const char current = GENETIC_CODE[b1 * 16 + b2 * 4 + b3];
+                if (aa != '\0' && aa != current) {
+                    return 'X';
+                }
+                aa = current;
+            }
+        }
+    }
+    return aa == '\0' ? 'X' : aa;
+}
+
+struct TranslatedOrf {
+    std::string sequence;
+    std::string header;
+};
+
+// Translation as translatenucs --add-orf-stop wrote it: a * before complete starts and after complete ends
+static void translateOrf(const char *seq, size_t from, size_t to, bool incompleteStart, bool incompleteEnd, std::string &out) {
+    out.clear();
+    if (incompleteStart == false) {
+        out.push_back('*');
+    }
+    for (size_t pos = from; pos + 3 <= to; pos += 3) {
+        out.push_back(translateCodon(seq + pos));
+    }
+    if (incompleteEnd == false && (out.empty() || out[out.size() - 1] != '*')) {
+        out.push_back('*');
+    }
+    out.push_back('\n');
+}
+
+struct OrfCounts {
+    size_t startOrfs;
+    size_t longOrfs;
+};
+
+// Finds the ORFs of one strand like extractorfs --orf-start-mode 0 (start to stop codon)
+// and keeps the ones of the two classes. Positions are reported on the forward strand.
+static void findOrfs(const char *seq, const unsigned char *flags, size_t len, bool minusStrand,
+                     const std::string &accession, unsigned int readKey,
+                     std::vector<TranslatedOrf> &orfs, OrfCounts &counts) {
+    // every frame starts inside an ORF, a stop codon before the first start codon
+    // then ends a fragment with an incomplete start
+    bool isInsideOrf[3] = {true, true, true};
+    bool hasStartCodon[3] = {false, false, false};
+    size_t countGaps[3] = {0, 0, 0};
+    size_t countLength[3] = {0, 0, 0};
+    size_t from[3] = {0, 1, 2};
+    char header[1024];
+
+    for (size_t pos = 0; pos + 3 <= len; pos++) {
+        const size_t frame = pos % 3;
+        const bool isLast = pos + 6 > len;
+        const unsigned char codon = flags[pos];
+
+        // do not start a new orf on the last codon
+        if (isInsideOrf[frame] == false && (codon & CODON_START) && isLast == false) {
+            isInsideOrf[frame] = true;
+            hasStartCodon[frame] = true;
+            from[frame] = pos;
+            countGaps[frame] = 0;
+            countLength[frame] = 0;
+        }
+        if (isInsideOrf[frame] == false) {
+            continue;
+        }
+        countLength[frame]++;
+        countGaps[frame] += (codon & CODON_GAP) != 0;
+
+        const bool isStop = (codon & CODON_STOP) != 0;
+        if (isStop == false && isLast == false) {
+            continue;
+        }
+        isInsideOrf[frame] = false;
+        // the stop codon is not part of the ORF
+        const size_t to = pos + (isLast ? 3 : 0);
+        if (to == from[frame] || countGaps[frame] > 0) {
+            continue;
+        }
+        const bool incompleteStart = hasStartCodon[frame] == false;
+        const bool incompleteEnd = isStop == false;
+        const size_t length = countLength[frame];
+        const bool isLong = length > LONG_ORF_MIN_CODONS && length <= LONG_ORF_MAX_CODONS;
+        const bool isStartFragment = length > START_ORF_MIN_CODONS && length <= START_ORF_MAX_CODONS
+                                     && incompleteStart == false && incompleteEnd == true;
+        if (isLong == false && isStartFragment == false) {
+            continue;
+        }
+        counts.longOrfs += isLong;
+        counts.startOrfs += isStartFragment;
+
+        orfs.push_back(TranslatedOrf());
+        TranslatedOrf &orf = orfs.back();
+        translateOrf(seq, from[frame], to, incompleteStart, incompleteEnd, orf.sequence);
+        size_t fromPos = from[frame];
+        size_t toPos = to - 1;
+        if (minusStrand) {
+            fromPos = len - 1 - fromPos;
+            toPos = len - 1 - toPos;
+        }
+        const int headerLen = snprintf(header, sizeof(header), "%.*s [Orf: %u, %zu, %zu, %d, %d, %d]\n",
+                                       static_cast<int>(std::min(accession.size(), static_cast<size_t>(900))), accession.c_str(),
+                                       readKey, fromPos, toPos, minusStrand ? -1 : 1, incompleteStart, incompleteEnd);
+        orf.header.assign(header, headerLen);
+    }
+}
+
+int sixframeorfs(int argc, const char **argv, const Command& command) {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, 2);
+    initBaseTables();
+
+    Debug(Debug::INFO) << "Sequence database: " << par.db1 << "\n";
+    DBReader<unsigned int> seqDb(par.db1.c_str(), par.db1Index.c_str());
+    seqDb.open(DBReader<unsigned int>::NOSORT);
+
+    std::string headerDbName = par.db1 + "_h";
+    DBReader<unsigned int> headerDb(headerDbName.c_str(), (headerDbName + ".index").c_str());
+    headerDb.open(DBReader<unsigned int>::NOSORT);
+
+    Debug(Debug::INFO) << "Output  file: " << par.db2 << "\n";
+    DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads));
+    dbw.open();
+    std::string outHeaderDbName = par.db2 + "_h";
+    DBWriter headerDbw(outHeaderDbName.c_str(), (outHeaderDbName + ".index").c_str(), static_cast<unsigned int>(par.threads));
+    headerDbw.open();
+
+    const size_t dbSize = seqDb.getSize();
+    std::vector<std::vector<TranslatedOrf> > roundOrfs(std::min(dbSize, ORF_ROUND_SIZE));
+    std::vector<unsigned int> firstKey(roundOrfs.size());
+    unsigned int nextKey = 0;
+    size_t startOrfs = 0;
+    size_t longOrfs = 0;
+
+    for (size_t roundStart = 0; roundStart < dbSize; roundStart += ORF_ROUND_SIZE) {
+        const size_t roundEnd = std::min(roundStart + ORF_ROUND_SIZE, dbSize);
+
+#pragma omp parallel reduction(+:startOrfs, longOrfs)
+        {
+            unsigned int thread_idx = 0;
+#ifdef OPENMP
+            thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+            std::vector<char> forward, reverse;
+            std::vector<unsigned char> forwardGap, reverseGap, flags;
+            OrfCounts counts = {0, 0};
+
+#pragma omp for schedule(dynamic, 256)
+            for (size_t id = roundStart; id < roundEnd; id++) {
+                std::vector<TranslatedOrf> &orfs = roundOrfs[id - roundStart];
+                orfs.clear();
+                // -2 dont read \n and \0
+                const size_t len = seqDb.getSeqLens(id) - 2;
+                if (len < 3) {
+                    continue;
+                }
+                const unsigned int readKey = seqDb.getDbKey(id);
+                const size_t headerId = headerDb.getId(readKey);
+                if (headerId == UINT_MAX) {
+                    Debug(Debug::ERROR) << "Missing header for read " << readKey << ".\n";
+                    EXIT(EXIT_FAILURE);
+                }
+                const char *headerData = headerDb.getData(headerId);
+                const size_t accessionLen = strcspn(headerData, " \t\n");
+                const std::string accession(headerData, accessionLen);
+
+                normalizeSequence(seqDb.getData(id), len, forward, forwardGap);
+                scanCodons(forward.data(), forwardGap.data(), len, flags);
+                findOrfs(forward.data(), flags.data(), len, false, accession, readKey, orfs, counts);
+
+                reverseComplement(forward, forwardGap, len, reverse, reverseGap);
+                scanCodons(reverse.data(), reverseGap.data(), len, flags);
+                findOrfs(reverse.data(), flags.data(), len, true, accession, readKey, orfs, counts);
+            }
+
+            // keys in read order, so the output does not depend on the thread scheduling
+#pragma omp single
+            for (size_t id = roundStart; id < roundEnd; id++) {
+                firstKey[id - roundStart] = nextKey;
+                nextKey += static_cast<unsigned int>(roundOrfs[id - roundStart].size());
+            }
+
+#pragma omp for schedule(dynamic, 256)
+            for (size_t id = roundStart; id < roundEnd; id++) {
+                const std::vector<TranslatedOrf> &orfs = roundOrfs[id - roundStart];
+                for (size_t i = 0; i < orfs.size(); i++) {
+                    const unsigned int key = firstKey[id - roundStart] + static_cast<unsigned int>(i);
+                    dbw.writeData(orfs[i].sequence.c_str(), orfs[i].sequence.size(), key, thread_idx);
+                    headerDbw.writeData(orfs[i].header.c_str(), orfs[i].header.size(), key, thread_idx);
+                }
+            }
+            startOrfs += counts.startOrfs;
+            longOrfs += counts.longOrfs;
+        }
+    }
+
+    // the workflow skips this step if the sequences exist, so they are written last
+    headerDbw.close();
+    dbw.close(Sequence::AMINO_ACIDS);
+    headerDb.close();
+    seqDb.close();
+
+    Debug(Debug::INFO) << "Long ORFs: " << longOrfs << ", start fragments: " << startOrfs << " in " << dbSize << " sequences\n";
+
+    return EXIT_SUCCESS;
+}
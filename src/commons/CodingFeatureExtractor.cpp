@@ -0,0 +1,116 @@
+#include "CodingFeatureExtractor.h"
+#include "BaseMatrix.h"
+#include "Debug.h"
+#include "Util.h"
+
+#include <cstring>
+
+CodingFeatureExtractor::CodingFeatureExtractor(const BaseMatrix &subMat, const BaseMatrix &redMat) {
+    aaX = subMat.alphabetSize - 1;
+    reducedX = redMat.alphabetSize - 1;
+    if (subMat.alphabetSize > MAX_AA || redMat.alphabetSize > MAX_REDUCED_AA) {
+        Debug(Debug::ERROR) << "Alphabet is too large for the coding feature extraction.\n";
+        EXIT(EXIT_FAILURE);
+    }
+    featureCount = aaX + reducedX * reducedX;
+
+    // same replacements as Sequence::mapSequence, all other characters are X
+    for (int c = 0; c < 256; c++) {
+        int aa = aaX;
+        int reduced = reducedX;
+        char curr = static_cast<char>(c);
+        if (curr >= 'a' && curr <= 'z') {
+            curr = curr - 'a' + 'A';
+        }
+        switch (curr) {
+            case 'J': curr = 'L'; break;
+            case 'U':
+            case 'O': curr = 'X'; break;
+            case 'Z': curr = 'E'; break;
+            case 'B': curr = 'D'; break;
+        }
+        if (curr >= 'A' && curr <= 'Z') {
+            aa = subMat.aa2int[static_cast<int>(curr)];
+            reduced = redMat.aa2int[static_cast<int>(curr)];
+            if (aa < 0 || aa > aaX) {
+                aa = aaX;
+            }
+            if (reduced < 0 || reduced > reducedX) {
+                reduced = reducedX;
+            }
+        }
+        lookup[c] = static_cast<unsigned char>(aa | (reduced << AA_BITS));
+    }
+}
+
+size_t CodingFeatureExtractor::extract(const char *seq, size_t len, float *row) {
+    memset(aaLaneCount, 0, sizeof(aaLaneCount));
+    memset(diLaneCount, 0, sizeof(diLaneCount));
+
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(seq);
+    const unsigned int aaMask = MAX_AA - 1;
+    // a dipeptide is counted at (first + MAX_REDUCED_AA * second), this is the order of Indexer::int2index
+    // the first residue forms a dipeptide with X, which is ignored later
+    unsigned int prev = static_cast<unsigned int>(reducedX);
+    size_t pos = 0;
+    for (; pos + LANES <= len; pos += LANES) {
+        const unsigned int c0 = lookup[s[pos]];
+        const unsigned int c1 = lookup[s[pos + 1]];
+        const unsigned int c2 = lookup[s[pos + 2]];
+        const unsigned int c3 = lookup[s[pos + 3]];
+        const unsigned int r0 = c0 >> AA_BITS;
+        const unsigned int r1 = c1 >> AA_BITS;
+        const unsigned int r2 = c2 >> AA_BITS;
+        const unsigned int r3 = c3 >> AA_BITS;
+        aaLaneCount[0][c0 & aaMask]++;
+        aaLaneCount[1][c1 & aaMask]++;
+        aaLaneCount[2][c2 & aaMask]++;
+        aaLaneCount[3][c3 & aaMask]++;
+        diLaneCount[0][prev + MAX_REDUCED_AA * r0]++;
+        diLaneCount[1][r0 + MAX_REDUCED_AA * r1]++;
+        diLaneCount[2][r1 + MAX_REDUCED_AA * r2]++;
+        diLaneCount[3][r2 + MAX_REDUCED_AA * r3]++;
+        prev = r3;
+    }
+    for (; pos < len; pos++) {
+        const unsigned int c = lookup[s[pos]];
+        const unsigned int r = c >> AA_BITS;
+        aaLaneCount[0][c & aaMask]++;
+        diLaneCount[0][prev + MAX_REDUCED_AA * r]++;
+        prev = r;
+    }
+
+    uint32_t diCount[MAX_REDUCED_AA * MAX_REDUCED_AA];
+    for (int i = 0; i < MAX_AA; i++) {
+        aaCount[i] = aaLaneCount[0][i] + aaLaneCount[1][i] + aaLaneCount[2][i] + aaLaneCount[3][i];
+    }
+    for (int i = 0; i < MAX_REDUCED_AA * MAX_REDUCED_AA; i++) {
+        diCount[i] = diLaneCount[0][i] + diLaneCount[1][i] + diLaneCount[2][i] + diLaneCount[3][i];
+    }
+
+    uint32_t totalAACnt = 0;
+    for (int aa = 0; aa < aaX; aa++) {
+        totalAACnt += aaCount[aa];
+    }
+    uint32_t totalDiAACnt = 0;
+    for (int second = 0; second < reducedX; second++) {
+        for (int first = 0; first < reducedX; first++) {
+            totalDiAACnt += diCount[first + MAX_REDUCED_AA * second];
+        }
+    }
+
+    // every count starts with a pseudo count of one
+    const float aaNorm = static_cast<float>(totalAACnt + aaX);
+    for (int aa = 0; aa < aaX; aa++) {
+        row[aa] = static_cast<float>(aaCount[aa] + 1) / aaNorm;
+    }
+    const float diNorm = static_cast<float>(totalDiAACnt + reducedX * reducedX);
+    float *diRow = row + aaX;
+    for (int second = 0; second < reducedX; second++) {
+        for (int first = 0; first < reducedX; first++) {
+            diRow[second * reducedX + first] = static_cast<float>(diCount[first + MAX_REDUCED_AA * second] + 1) / diNorm;
+        }
+    }
+
+    return totalAACnt;
+}
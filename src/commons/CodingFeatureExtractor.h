@@ -0,0 +1,53 @@
+#ifndef CODINGFEATUREEXTRACTOR_H
+#define CODINGFEATUREEXTRACTOR_H
+
+#include <cstddef>
+#include <stdint.h>
+
+class BaseMatrix;
+
+// Computes the composition features of the coding/non-coding classifier in a
+// single pass over the ASCII sequence:
+//   * (count + 1) / (total + 20) for each of the 20 amino acids
+//   * (count + 1) / (total + 36) for each dipeptide of the 6 letter reduced alphabet
+// X (and everything that maps to X) is ignored, dipeptides containing X as well.
+// The feature order is identical to counting with Sequence and Indexer.
+class CodingFeatureExtractor {
+public:
+    CodingFeatureExtractor(const BaseMatrix &subMat, const BaseMatrix &redMat);
+
+    // number of floats written by extract
+    size_t getFeatureCount() const {
+        return featureCount;
+    }
+
+    // reads exactly len characters of seq, a '\0' does not end it, and writes getFeatureCount() floats into row
+    // returns the number of residues that are not X
+    size_t extract(const char *seq, size_t len, float *row);
+
+    // raw counts of the last call to extract, indexed by amino acid of subMat
+    const uint32_t *getAminoAcidCounts() const {
+        return aaCount;
+    }
+
+private:
+    // one byte per ASCII character, the lower 5 bits encode the amino acid
+    // and the upper 3 bits its reduced amino acid
+    static const int AA_BITS = 5;
+    static const int MAX_AA = 1 << AA_BITS;
+    static const int MAX_REDUCED_AA = 1 << (8 - AA_BITS);
+    // independent counters so that consecutive increments do not wait on each other
+    static const int LANES = 4;
+
+    unsigned char lookup[256];
+
+    int aaX;
+    int reducedX;
+    size_t featureCount;
+
+    uint32_t aaLaneCount[LANES][MAX_AA];
+    uint32_t diLaneCount[LANES][MAX_REDUCED_AA * MAX_REDUCED_AA];
+    uint32_t aaCount[MAX_AA];
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "CodingModel.h"
+#include "CodingFeatureExtractor.h"
+#include "Debug.h"
+#include "Util.h"
+
+#include "kerasify/keras_model.h"
+#include "predict_coding_acc9260_56x96.model.aligned.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+void loadCodingModel(KerasModel &model, const std::string &modelFile) {
+    if (modelFile.empty()) {
+        // the embedded model is aligned and used in place
+        if (model.LoadModel((const char *)predict_coding_acc9260_56x96_model, predict_coding_acc9260_56x96_model_len) == false) {
+            Debug(Debug::ERROR) << "Could not load embedded coding model\n";
+            EXIT(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    Debug(Debug::INFO) << "Coding model: " << modelFile << "\n";
+    std::ifstream file(modelFile.c_str(), std::ios::binary);
+    if (file.fail()) {
+        Debug(Debug::ERROR) << "Could not open coding model " << modelFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (model.LoadModel(data) == false) {
+        Debug(Debug::ERROR) << "Could not load coding model " << modelFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+// shorter sequences do not carry enough composition signal
+static const size_t MIN_CODING_LENGTH = 20;
+// maximal fraction of residues that are X or not an amino acid
+static const float MAX_X_FRACTION = 0.5f;
+// maximal fraction of the most frequent amino acid
+static const float MAX_SINGLE_AA_FRACTION = 0.5f;
+
+CodingPrefilterStage codingPrefilterStage(const char *seq, size_t len, const CodingFeatureExtractor &extractor,
+                                          size_t aaCount, int alphabetSize) {
+    // without the trailing newline and stop codon
+    while (len > 0 && (seq[len - 1] == '\n' || seq[len - 1] == '*')) {
+        len--;
+    }
+    // translatenucs --add-orf-stop, sixframeorfs and findassemblystart mark a complete start
+    // with a '*' in front of the first residue
+    const size_t firstResidue = (len > 0 && seq[0] == '*') ? 1 : 0;
+    const size_t residues = len - firstResidue;
+    if (residues < MIN_CODING_LENGTH) {
+        return PREFILTER_LENGTH;
+    }
+    if (memchr(seq + firstResidue, '*', residues) != NULL) {
+        return PREFILTER_STOP;
+    }
+    if (aaCount < (1.0f - MAX_X_FRACTION) * residues) {
+        return PREFILTER_X;
+    }
+    const uint32_t *counts = extractor.getAminoAcidCounts();
+    const uint32_t maxCount = *std::max_element(counts, counts + alphabetSize - 1);
+    if (maxCount > MAX_SINGLE_AA_FRACTION * aaCount) {
+        return PREFILTER_COMPLEXITY;
+    }
+    return PREFILTER_PASS;
+}
+
+const char *codingPrefilterStageName(CodingPrefilterStage stage) {
+    switch (stage) {
+        case PREFILTER_LENGTH: return "length";
+        case PREFILTER_STOP: return "stop codon";
+        case PREFILTER_X: return "X fraction";
+        case PREFILTER_COMPLEXITY: return "low complexity";
+        default: return "none";
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef CODINGMODEL_H
+#define CODINGMODEL_H
+
+#include <cstddef>
+#include <string>
+
+class KerasModel;
+class CodingFeatureExtractor;
+
+// Loads a kerasify model to predict coding sequences from modelFile,
+// or the embedded model if modelFile is empty. Exits on failure.
+void loadCodingModel(KerasModel &model, const std::string &modelFile);
+
+// Rules of the optional prefilter cascade, a sequence failing one of them is rejected
+// without running the coding model. checkcodingmodel reports how often each rule
+// disagrees with the model on labeled sequences.
+enum CodingPrefilterStage {
+    PREFILTER_PASS = 0,
+    PREFILTER_LENGTH,
+    PREFILTER_STOP,
+    PREFILTER_X,
+    PREFILTER_COMPLEXITY,
+    PREFILTER_STAGE_COUNT
+};
+
+// First rule that rejects seq (len characters), extractor has to hold the counts of
+// extract(seq, len) whose result is aaCount
+CodingPrefilterStage codingPrefilterStage(const char *seq, size_t len, const CodingFeatureExtractor &extractor,
+                                          size_t aaCount, int alphabetSize);
+
+// name of the stage for the statistics
+const char *codingPrefilterStageName(CodingPrefilterStage stage);
+
+#endif
@@ -0,0 +1,264 @@
+#include "KSeqBgzf.h"
+#include "Debug.h"
+#include "Util.h"
+
+#include "kseq/kseq.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+namespace KSEQSTDIN {
+    KSEQ_INIT(int, read)
+}
+
+KSeqStdin::KSeqStdin() {
+    seq = (void*) KSEQSTDIN::kseq_init(STDIN_FILENO);
+}
+
+bool KSeqStdin::ReadEntry() {
+    KSEQSTDIN::kseq_t* s = (KSEQSTDIN::kseq_t*) seq;
+    int result = KSEQSTDIN::kseq_read(s);
+    if (result < 0)
+        return false;
+    entry.name = s->name;
+    entry.comment = s->comment;
+    entry.sequence = s->seq;
+    entry.qual = s->qual;
+    return true;
+}
+
+KSeqStdin::~KSeqStdin() {
+    KSEQSTDIN::kseq_destroy((KSEQSTDIN::kseq_t*)seq);
+}
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+struct BgzfBlock {
+    std::vector<unsigned char> compressed;
+    std::vector<unsigned char> data;
+    bool failed;
+};
+
+// Hands out the inflated bytes of a BGZF file in order, inflating blockGroup blocks at a time
+class BgzfBlockReader {
+public:
+    BgzfBlockReader(const char *fileName, size_t blockGroup)
+            : fileName(fileName), blocks(blockGroup), blockCount(0), current(0), offset(0) {
+        file = fopen(fileName, "rb");
+        if (file == NULL) {
+            Debug(Debug::ERROR) << "Could not open " << fileName << " for reading.\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+
+    ~BgzfBlockReader() {
+        fclose(file);
+    }
+
+    // same contract as read(2), 0 at the end of the file
+    int read(void *buffer, size_t length) {
+        size_t copied = 0;
+        while (copied < length) {
+            if (current == blockCount) {
+                if (fillGroup() == false) {
+                    break;
+                }
+                continue;
+            }
+            const std::vector<unsigned char> &data = blocks[current].data;
+            const size_t available = std::min(data.size() - offset, length - copied);
+            memcpy(static_cast<char *>(buffer) + copied, data.data() + offset, available);
+            copied += available;
+            offset += available;
+            if (offset == data.size()) {
+                current++;
+                offset = 0;
+            }
+        }
+        return static_cast<int>(copied);
+    }
+
+private:
+    static const size_t HEADER_SIZE = 12;
+    static const size_t TRAILER_SIZE = 8;
+
+    const char *fileName;
+    FILE *file;
+    std::vector<BgzfBlock> blocks;
+    size_t blockCount;
+    size_t current;
+    size_t offset;
+    unsigned char extra[65536];
+
+    static unsigned int readLittleEndian(const unsigned char *bytes, size_t count) {
+        unsigned int value = 0;
+        for (size_t i = 0; i < count; i++) {
+            value |= static_cast<unsigned int>(bytes[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    void fail(const char *reason) {
+        Debug(Debug::ERROR) << "Invalid BGZF file " << fileName << ": " << reason << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    // reads the next compressed block, false at the end of the file
+    bool readBlock(BgzfBlock &block) {
+        unsigned char header[HEADER_SIZE];
+        const size_t headerRead = fread(header, 1, HEADER_SIZE, file);
+        if (headerRead == 0) {
+            return false;
+        }
+        if (headerRead != HEADER_SIZE || header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || (header[3] & 4) == 0) {
+            fail("block without gzip header");
+        }
+        const size_t extraLength = readLittleEndian(header + 10, 2);
+        if (fread(extra, 1, extraLength, file) != extraLength) {
+            fail("truncated block header");
+        }
+        size_t blockSize = 0;
+        for (size_t pos = 0; pos + 4 <= extraLength;) {
+            const size_t fieldLength = readLittleEndian(extra + pos + 2, 2);
+            if (extra[pos] == 'B' && extra[pos + 1] == 'C' && fieldLength == 2 && pos + 6 <= extraLength) {
+                blockSize = readLittleEndian(extra + pos + 4, 2) + 1;
+                break;
+            }
+            pos += 4 + fieldLength;
+        }
+        if (blockSize < HEADER_SIZE + extraLength + TRAILER_SIZE) {
+            fail("block without BGZF block size");
+        }
+        block.compressed.resize(blockSize - HEADER_SIZE - extraLength);
+        if (fread(block.compressed.data(), 1, block.compressed.size(), file) != block.compressed.size()) {
+            fail("truncated block");
+        }
+        return true;
+    }
+
+    static void inflateBlock(BgzfBlock &block) {
+        const unsigned char *trailer = block.compressed.data() + block.compressed.size() - TRAILER_SIZE;
+        const unsigned int crc = readLittleEndian(trailer, 4);
+        block.data.resize(readLittleEndian(trailer + 4, 4));
+        block.failed = true;
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(z_stream));
+        // raw deflate, the gzip header was already parsed
+        if (inflateInit2(&stream, -15) != Z_OK) {
+            return;
+        }
+        stream.next_in = block.compressed.data();
+        stream.avail_in = static_cast<uInt>(block.compressed.size() - TRAILER_SIZE);
+        // the empty EOF block has no buffer, but inflate rejects a NULL output
+        unsigned char empty;
+        stream.next_out = block.data.empty() ? &empty : block.data.data();
+        stream.avail_out = static_cast<uInt>(block.data.size());
+        const int status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END || stream.total_out != block.data.size()) {
+            return;
+        }
+        block.failed = crc32(crc32(0L, Z_NULL, 0), block.data.data(), static_cast<uInt>(block.data.size())) != crc;
+    }
+
+    // reads the next group of blocks and inflates them in parallel, false at the end of the file
+    bool fillGroup() {
+        blockCount = 0;
+        while (blockCount < blocks.size() && readBlock(blocks[blockCount])) {
+            blockCount++;
+        }
+        current = 0;
+        offset = 0;
+        // tasks also run on threads that are idle in the enclosing parallel region
+        for (size_t i = 0; i < blockCount; i++) {
+            BgzfBlock *block = &blocks[i];
+#pragma omp task firstprivate(block)
+            inflateBlock(*block);
+        }
+#pragma omp taskwait
+        for (size_t i = 0; i < blockCount; i++) {
+            if (blocks[i].failed) {
+                fail("corrupt block");
+            }
+        }
+        return blockCount > 0;
+    }
+
+    BgzfBlockReader(const BgzfBlockReader&);
+    BgzfBlockReader& operator=(const BgzfBlockReader&);
+};
+
+static int bgzfRead(BgzfBlockReader *reader, void *buffer, size_t length) {
+    return reader->read(buffer, length);
+}
+
+namespace KSEQBGZF {
+    KSEQ_INIT(BgzfBlockReader*, bgzfRead)
+}
+
+// blocks per thread and group, every block inflates to at most 64 KB
+static const size_t BGZF_BLOCKS_PER_THREAD = 4;
+
+KSeqBgzf::KSeqBgzf(const char *fileName, unsigned int threads) {
+    reader = new BgzfBlockReader(fileName, std::max(threads, 1u) * BGZF_BLOCKS_PER_THREAD);
+    seq = (void*) KSEQBGZF::kseq_init(reader);
+}
+
+bool KSeqBgzf::ReadEntry() {
+    KSEQBGZF::kseq_t* s = (KSEQBGZF::kseq_t*) seq;
+    int result = KSEQBGZF::kseq_read(s);
+    if (result < 0)
+        return false;
+    entry.name = s->name;
+    entry.comment = s->comment;
+    entry.sequence = s->seq;
+    entry.qual = s->qual;
+    return true;
+}
+
+KSeqBgzf::~KSeqBgzf() {
+    KSEQBGZF::kseq_destroy((KSEQBGZF::kseq_t*)seq);
+    delete reader;
+}
+
+bool KSeqBgzf::isBgzf(const char *fileName) {
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    unsigned char header[16];
+    const bool isBgzf = fread(header, 1, sizeof(header), file) == sizeof(header)
+                        && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4) != 0
+                        && header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+    fclose(file);
+    return isBgzf;
+}
+
+KSeqWrapper* KSeqBgzfFactory(const char *fileName, unsigned int threads) {
+    if (strcmp(fileName, "-") == 0) {
+        return new KSeqStdin();
+    }
+    if (KSeqBgzf::isBgzf(fileName)) {
+        return new KSeqBgzf(fileName, threads);
+    }
+    return KSeqFactory(fileName);
+}
+
+#else
+
+KSeqWrapper* KSeqBgzfFactory(const char *fileName, unsigned int) {
+    if (strcmp(fileName, "-") == 0) {
+        return new KSeqStdin();
+    }
+    return KSeqFactory(fileName);
+}
+
+#endif
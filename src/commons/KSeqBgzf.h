@@ -0,0 +1,40 @@
+#ifndef KSEQBGZF_H
+#define KSEQBGZF_H
+
+#include <mmseqs/src/commons/KSeqWrapper.h>
+
+#include <cstdio>
+
+class BgzfBlockReader;
+
+// Reads BGZF compressed FASTA/FASTQ files (as written by bgzip or samtools).
+// BGZF files are a series of independent gzip blocks of at most 64 KB, so groups of
+// blocks are inflated in parallel as OpenMP tasks, at most blockGroup blocks are kept in memory.
+class KSeqBgzf : public KSeqWrapper {
+public:
+    KSeqBgzf(const char *fileName, unsigned int threads);
+    bool ReadEntry();
+    ~KSeqBgzf();
+
+    // true if the file starts with a gzip header that carries the BGZF block size
+    static bool isBgzf(const char *fileName);
+
+private:
+    BgzfBlockReader *reader;
+
+    KSeqBgzf(const KSeqBgzf&);
+    KSeqBgzf& operator=(const KSeqBgzf&);
+};
+
+// Reads uncompressed FASTA/FASTQ from stdin
+class KSeqStdin : public KSeqWrapper {
+public:
+    KSeqStdin();
+    bool ReadEntry();
+    ~KSeqStdin();
+};
+
+// Opens - as stdin, BGZF files with KSeqBgzf and everything else (including plain gzip) with KSeqFactory
+KSeqWrapper* KSeqBgzfFactory(const char *fileName, unsigned int threads);
+
+#endif
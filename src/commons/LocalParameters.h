@@ -21,9 +21,67 @@ public:
     std::vector<MMseqsParameter> assembleresults;
     std::vector<MMseqsParameter> hybridassembleresults;
     std::vector<MMseqsParameter> assemblerworkflow;
+    std::vector<MMseqsParameter> filternoncoding;
+    std::vector<MMseqsParameter> checkcodingmodel;
+    std::vector<MMseqsParameter> mergereads;
+    std::vector<MMseqsParameter> dereplicate;
+    std::vector<MMseqsParameter> diginorm;
+    std::vector<MMseqsParameter> filtersolidkmers;
+    std::vector<MMseqsParameter> sixframeorfs;
+
+    PARAMETER(PARAM_CODING_MODEL)
+    PARAMETER(PARAM_CODING_THRESHOLD)
+    PARAMETER(PARAM_CODING_INT8)
+    PARAMETER(PARAM_CODING_PREFILTER)
+    PARAMETER(PARAM_CODING_SCORES)
+    PARAMETER(PARAM_EXTENDED_FROM)
+    PARAMETER(PARAM_MERGE_SEED_KMER)
+    PARAMETER(PARAM_DEREPLICATE)
+    PARAMETER(PARAM_DIGINORM_COVERAGE)
+    PARAMETER(PARAM_DIGINORM_KMER)
+    PARAMETER(PARAM_DIGINORM_MEMORY)
+    PARAMETER(PARAM_TRIM_QUALITY)
+    PARAMETER(PARAM_TRIM_WINDOW)
+    PARAMETER(PARAM_ADAPTERS)
+    PARAMETER(PARAM_SOLID_KMER_FILTER)
+    PARAMETER(PARAM_SOLID_KMER_MEMORY)
+    std::string codingModel;
+    float codingThreshold;
+    int codingInt8;
+    int codingPrefilter;
+    std::string codingScores;
+    std::string extendedFrom;
+    int mergeSeedKmer;
+    int dereplicateReads;
+    int diginormCoverage;
+    int diginormKmer;
+    int diginormMemory;
+    int trimQuality;
+    int trimWindow;
+    std::string adapters;
+    int solidKmerFilter;
+    int solidKmerMemory;
 
 private:
-    LocalParameters() : Parameters() {
+    LocalParameters() :
+            Parameters(),
+            PARAM_CODING_MODEL(PARAM_CODING_MODEL_ID,"--coding-model", "Coding model", "kerasify model file to predict coding sequences, if empty the embedded model is used", typeid(std::string), (void *) &codingModel, "^.*$"),
+            PARAM_CODING_THRESHOLD(PARAM_CODING_THRESHOLD_ID,"--coding-threshold", "Coding threshold", "keep sequences with a coding score above the threshold [0.0,1.0]", typeid(float), (void *) &codingThreshold, "^(0(\\.[0-9]+)?|1(\\.0+)?)$"),
+            PARAM_CODING_INT8(PARAM_CODING_INT8_ID,"--coding-int8", "Coding int8", "predict with int8 quantized weights [0,1]", typeid(int), (void *) &codingInt8, "^[0-1]{1}$"),
+            PARAM_CODING_PREFILTER(PARAM_CODING_PREFILTER_ID,"--coding-prefilter", "Coding prefilter", "reject short, stop codon containing, X-rich and low complexity sequences before the coding model, checkcodingmodel reports where these rules disagree with the model [0,1]", typeid(int), (void *) &codingPrefilter, "^[0-1]{1}$"),
+            PARAM_CODING_SCORES(PARAM_CODING_SCORES_ID,"--coding-scores", "Coding scores", "write the coding score of each sequence as binary (key, score) records to this file, NaN if the prefilter rejected it", typeid(std::string), (void *) &codingScores, "^.*$"),
+            PARAM_EXTENDED_FROM(PARAM_EXTENDED_FROM_ID,"--extended-from", "Extended from", "sequence database the assembly started from, only sequences that got longer are kept", typeid(std::string), (void *) &extendedFrom, "^.*$"),
+            PARAM_MERGE_SEED_KMER(PARAM_MERGE_SEED_KMER_ID,"--merge-seed-kmer", "Merge seed k-mer", "only score read overlaps that share a k-mer of this length, 0 scores every overlap [0,16]", typeid(int), (void *) &mergeSeedKmer, "^([0-9]|1[0-6])$"),
+            PARAM_DEREPLICATE(PARAM_DEREPLICATE_ID,"--dereplicate", "Dereplicate", "collapse identical reads before assembly [0,1]", typeid(int), (void *) &dereplicateReads, "^[0-1]{1}$"),
+            PARAM_DIGINORM_COVERAGE(PARAM_DIGINORM_COVERAGE_ID,"--diginorm-coverage", "Diginorm coverage", "drop reads whose median k-mer abundance reached this coverage, 0 disables digital normalization", typeid(int), (void *) &diginormCoverage, "^[0-9]{1}[0-9]*$"),
+            PARAM_DIGINORM_KMER(PARAM_DIGINORM_KMER_ID,"--diginorm-kmer", "Diginorm k-mer", "k-mer length to estimate the read coverage [8,32]", typeid(int), (void *) &diginormKmer, "^([8-9]|[1-2][0-9]|3[0-2])$"),
+            PARAM_DIGINORM_MEMORY(PARAM_DIGINORM_MEMORY_ID,"--diginorm-memory", "Diginorm memory", "memory in MB of the k-mer count sketch", typeid(int), (void *) &diginormMemory, "^[1-9]{1}[0-9]*$"),
+            PARAM_TRIM_QUALITY(PARAM_TRIM_QUALITY_ID,"--trim-quality", "Trim quality", "cut reads at the first window with a mean phred quality below this, 0 disables quality trimming [0,60]", typeid(int), (void *) &trimQuality, "^([0-9]|[1-5][0-9]|60)$"),
+            PARAM_TRIM_WINDOW(PARAM_TRIM_WINDOW_ID,"--trim-window", "Trim window", "window length of the quality trimming [1,64]", typeid(int), (void *) &trimWindow, "^([1-9]|[1-5][0-9]|6[0-4])$"),
+            PARAM_ADAPTERS(PARAM_ADAPTERS_ID,"--adapters", "Adapters", "comma separated adapter sequences that are clipped from the reads", typeid(std::string), (void *) &adapters, "^[ACGTacgt,]*$"),
+            PARAM_SOLID_KMER_FILTER(PARAM_SOLID_KMER_FILTER_ID,"--solid-kmer-filter", "Solid k-mer filter", "assemble ORF fragments without a k-mer that occurs at least twice only from the second iteration on [0,1]", typeid(int), (void *) &solidKmerFilter, "^[0-1]{1}$"),
+            PARAM_SOLID_KMER_MEMORY(PARAM_SOLID_KMER_MEMORY_ID,"--solid-kmer-memory", "Solid k-mer memory", "memory in MB of the solid k-mer Bloom filters", typeid(int), (void *) &solidKmerMemory, "^[1-9]{1}[0-9]*$")
+    {
         // assembleresult
         assembleresults.push_back(PARAM_MIN_SEQ_ID);
         assembleresults.push_back(PARAM_V);
@@ -34,12 +92,85 @@ private:
         assemblerworkflow.push_back(PARAM_NUM_ITERATIONS);
         assemblerworkflow.push_back(PARAM_REMOVE_TMP_FILES);
         assemblerworkflow.push_back(PARAM_RUNNER);
+        assemblerworkflow.push_back(PARAM_DEREPLICATE);
+        assemblerworkflow.push_back(PARAM_DIGINORM_COVERAGE);
+        assemblerworkflow.push_back(PARAM_DIGINORM_KMER);
+        assemblerworkflow.push_back(PARAM_DIGINORM_MEMORY);
+        assemblerworkflow.push_back(PARAM_TRIM_QUALITY);
+        assemblerworkflow.push_back(PARAM_TRIM_WINDOW);
+        assemblerworkflow.push_back(PARAM_ADAPTERS);
+        assemblerworkflow.push_back(PARAM_SOLID_KMER_FILTER);
+        assemblerworkflow.push_back(PARAM_SOLID_KMER_MEMORY);
 
         //
         hybridassembleresults = combineList(rescorediagonal, kmermatcher);
         hybridassembleresults.push_back(PARAM_NUM_ITERATIONS);
         hybridassembleresults.push_back(PARAM_REMOVE_TMP_FILES);
         hybridassembleresults.push_back(PARAM_RUNNER);
+
+        // filternoncoding
+        filternoncoding.push_back(PARAM_CODING_MODEL);
+        filternoncoding.push_back(PARAM_CODING_THRESHOLD);
+        filternoncoding.push_back(PARAM_CODING_INT8);
+        filternoncoding.push_back(PARAM_CODING_PREFILTER);
+        filternoncoding.push_back(PARAM_CODING_SCORES);
+        filternoncoding.push_back(PARAM_EXTENDED_FROM);
+        filternoncoding.push_back(PARAM_THREADS);
+        filternoncoding.push_back(PARAM_V);
+
+        // checkcodingmodel
+        checkcodingmodel.push_back(PARAM_CODING_MODEL);
+        checkcodingmodel.push_back(PARAM_CODING_THRESHOLD);
+        checkcodingmodel.push_back(PARAM_THREADS);
+        checkcodingmodel.push_back(PARAM_V);
+
+        // mergereads
+        mergereads.push_back(PARAM_MERGE_SEED_KMER);
+        mergereads.push_back(PARAM_TRIM_QUALITY);
+        mergereads.push_back(PARAM_TRIM_WINDOW);
+        mergereads.push_back(PARAM_ADAPTERS);
+        mergereads.push_back(PARAM_THREADS);
+        mergereads.push_back(PARAM_V);
+
+        // dereplicate
+        dereplicate.push_back(PARAM_THREADS);
+        dereplicate.push_back(PARAM_V);
+
+        // diginorm
+        diginorm.push_back(PARAM_DIGINORM_COVERAGE);
+        diginorm.push_back(PARAM_DIGINORM_KMER);
+        diginorm.push_back(PARAM_DIGINORM_MEMORY);
+        diginorm.push_back(PARAM_THREADS);
+        diginorm.push_back(PARAM_V);
+
+        // filtersolidkmers
+        filtersolidkmers.push_back(PARAM_SUB_MAT);
+        filtersolidkmers.push_back(PARAM_ALPH_SIZE);
+        filtersolidkmers.push_back(PARAM_K);
+        filtersolidkmers.push_back(PARAM_SOLID_KMER_MEMORY);
+        filtersolidkmers.push_back(PARAM_THREADS);
+        filtersolidkmers.push_back(PARAM_V);
+
+        // sixframeorfs
+        sixframeorfs.push_back(PARAM_THREADS);
+        sixframeorfs.push_back(PARAM_V);
+
+        codingModel = "";
+        codingThreshold = 0.2;
+        codingInt8 = 0;
+        codingPrefilter = 0;
+        codingScores = "";
+        extendedFrom = "";
+        mergeSeedKmer = 0;
+        dereplicateReads = 0;
+        diginormCoverage = 0;
+        diginormKmer = 20;
+        diginormMemory = 1024;
+        trimQuality = 0;
+        trimWindow = 4;
+        adapters = "";
+        solidKmerFilter = 0;
+        solidKmerMemory = 1024;
     }
     LocalParameters(LocalParameters const&);
     ~LocalParameters() {};
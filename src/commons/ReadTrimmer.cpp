@@ -0,0 +1,188 @@
+#include "ReadTrimmer.h"
+#include "Debug.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline int baseCode(char c) {
+    switch (c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+    }
+}
+
+ReadTrimmer::ReadTrimmer(int minQuality, int windowSize, const std::string &adapterList)
+        : minQuality(minQuality), windowSize(static_cast<size_t>(std::max(windowSize, 1))),
+          adapterKmerBits((1 << (2 * ADAPTER_KMER)) / 64, 0) {
+    size_t start = 0;
+    while (start < adapterList.size()) {
+        size_t end = adapterList.find(',', start);
+        if (end == std::string::npos) {
+            end = adapterList.size();
+        }
+        std::string adapter = adapterList.substr(start, end - start);
+        start = end + 1;
+        if (adapter.empty()) {
+            continue;
+        }
+        for (size_t i = 0; i < adapter.size(); i++) {
+            adapter[i] = static_cast<char>(toupper(adapter[i]));
+            if (baseCode(adapter[i]) < 0) {
+                Debug(Debug::ERROR) << "Adapter " << adapter << " contains other bases than ACGT.\n";
+                EXIT(EXIT_FAILURE);
+            }
+        }
+        if (adapter.size() < ADAPTER_KMER) {
+            Debug(Debug::ERROR) << "Adapter " << adapter << " is shorter than " << ADAPTER_KMER << " bases.\n";
+            EXIT(EXIT_FAILURE);
+        }
+        adapters.push_back(adapter);
+    }
+
+    for (size_t a = 0; a < adapters.size(); a++) {
+        const std::string &adapter = adapters[a];
+        uint16_t kmer = 0;
+        for (size_t i = 0; i < adapter.size(); i++) {
+            kmer = static_cast<uint16_t>((kmer << 2) | baseCode(adapter[i]));
+            if (i + 1 >= ADAPTER_KMER) {
+                AdapterKmer entry;
+                entry.kmer = kmer;
+                entry.adapter = static_cast<uint16_t>(a);
+                entry.offset = static_cast<uint32_t>(i + 1 - ADAPTER_KMER);
+                adapterKmers.push_back(entry);
+                adapterKmerBits[kmer / 64] |= 1ULL << (kmer % 64);
+            }
+        }
+    }
+    std::stable_sort(adapterKmers.begin(), adapterKmers.end());
+}
+
+size_t ReadTrimmer::trimmedLength(const char *seq, const char *qual, size_t len) const {
+    size_t trimmed = len;
+    if (minQuality > 0 && qual != NULL) {
+        trimmed = qualityCut(qual, trimmed);
+    }
+    if (adapters.empty() == false) {
+        trimmed = std::min(trimmed, adapterCut(seq, len));
+    }
+    return trimmed;
+}
+
+size_t ReadTrimmer::qualityCut(const char *qual, size_t len) const {
+    if (len == 0) {
+        return 0;
+    }
+    // reads shorter than a window are judged as one window
+    const size_t window = std::min(windowSize, len);
+    const unsigned char *q = reinterpret_cast<const unsigned char *>(qual);
+    // the mean is below minQuality if the sum of the ASCII qualities is below this
+    const unsigned int threshold = static_cast<unsigned int>(minQuality + 33) * window;
+
+    size_t pos = 0;
+#ifdef __SSE2__
+    // 16 window sums at once, each lane sums its window from unaligned loads,
+    // window sizes up to 128 fit into 16 bit lanes
+    if (window <= 128) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i limit = _mm_set1_epi16(static_cast<short>(threshold));
+        for (; pos + 15 + window <= len; pos += 16) {
+            __m128i sumLo = zero;
+            __m128i sumHi = zero;
+            for (size_t j = 0; j < window; j++) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + pos + j));
+                sumLo = _mm_add_epi16(sumLo, _mm_unpacklo_epi8(v, zero));
+                sumHi = _mm_add_epi16(sumHi, _mm_unpackhi_epi8(v, zero));
+            }
+            const __m128i below = _mm_packs_epi16(_mm_cmplt_epi16(sumLo, limit), _mm_cmplt_epi16(sumHi, limit));
+            const int mask = _mm_movemask_epi8(below);
+            if (mask != 0) {
+                return pos + __builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+
+    // remaining windows with a running sum
+    if (pos + window > len) {
+        return len;
+    }
+    unsigned int sum = 0;
+    for (size_t j = 0; j < window; j++) {
+        sum += q[pos + j];
+    }
+    while (true) {
+        if (sum < threshold) {
+            return pos;
+        }
+        if (pos + window >= len) {
+            return len;
+        }
+        sum += q[pos + window];
+        sum -= q[pos];
+        pos++;
+    }
+}
+
+static size_t countMismatches(const std::string &adapter, const char *seq, size_t len) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < len; i++) {
+        mismatches += (toupper(seq[i]) != adapter[i]);
+    }
+    return mismatches;
+}
+
+size_t ReadTrimmer::adapterCut(const char *seq, size_t len) const {
+    size_t best = len;
+
+    // full adapter matches through their k-mers, the earliest adapter start wins
+    const uint16_t kmerMask = static_cast<uint16_t>((1 << (2 * ADAPTER_KMER)) - 1);
+    uint16_t kmer = 0;
+    unsigned int valid = 0;
+    for (size_t i = 0; i < len; i++) {
+        const int code = baseCode(seq[i]);
+        if (code < 0) {
+            valid = 0;
+            continue;
+        }
+        kmer = static_cast<uint16_t>(((kmer << 2) | code) & kmerMask);
+        if (++valid < ADAPTER_KMER || (adapterKmerBits[kmer / 64] & (1ULL << (kmer % 64))) == 0) {
+            continue;
+        }
+        const size_t kmerStart = i + 1 - ADAPTER_KMER;
+        AdapterKmer key;
+        key.kmer = kmer;
+        std::vector<AdapterKmer>::const_iterator it = std::lower_bound(adapterKmers.begin(), adapterKmers.end(), key);
+        for (; it != adapterKmers.end() && it->kmer == kmer; ++it) {
+            if (it->offset > kmerStart || kmerStart - it->offset >= best) {
+                continue;
+            }
+            const size_t adapterStart = kmerStart - it->offset;
+            const std::string &adapter = adapters[it->adapter];
+            const size_t overlap = std::min(len - adapterStart, adapter.size());
+            if (countMismatches(adapter, seq + adapterStart, overlap) <= overlap / 10) {
+                best = adapterStart;
+            }
+        }
+    }
+    if (best < len) {
+        return best;
+    }
+
+    // adapters that only start within the last k-mer of the read
+    for (size_t overlap = std::min(static_cast<size_t>(ADAPTER_KMER - 1), len); overlap >= ADAPTER_MIN_OVERLAP; overlap--) {
+        for (size_t a = 0; a < adapters.size(); a++) {
+            if (countMismatches(adapters[a], seq + len - overlap, overlap) == 0) {
+                return len - overlap;
+            }
+        }
+    }
+    return len;
+}
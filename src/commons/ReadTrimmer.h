@@ -0,0 +1,52 @@
+#ifndef READTRIMMER_H
+#define READTRIMMER_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Finds the length a read keeps after quality and adapter trimming:
+//   * the read is cut at the start of the first window of windowSize bases
+//     whose mean phred quality (offset 33) is below minQuality
+//   * the read is cut where one of the adapters starts, full adapter matches are
+//     seeded by k-mers and allow a mismatch per ten bases, adapter prefixes
+//     shorter than a k-mer have to match the end of the read exactly
+class ReadTrimmer {
+public:
+    // minQuality 0 disables quality trimming, adapters is a comma separated list of nucleotide sequences
+    ReadTrimmer(int minQuality, int windowSize, const std::string &adapters);
+
+    bool isEnabled() const {
+        return minQuality > 0 || adapters.empty() == false;
+    }
+
+    // qual is ignored if it is NULL
+    size_t trimmedLength(const char *seq, const char *qual, size_t len) const;
+
+private:
+    static const unsigned int ADAPTER_KMER = 8;
+    static const size_t ADAPTER_MIN_OVERLAP = 5;
+
+    struct AdapterKmer {
+        uint16_t kmer;
+        uint16_t adapter;
+        uint32_t offset;
+
+        bool operator<(const AdapterKmer &other) const {
+            return kmer < other.kmer;
+        }
+    };
+
+    int minQuality;
+    size_t windowSize;
+    std::vector<std::string> adapters;
+    // sorted by k-mer, with a bit per k-mer to reject most read k-mers without a search
+    std::vector<AdapterKmer> adapterKmers;
+    std::vector<uint64_t> adapterKmerBits;
+
+    size_t qualityCut(const char *qual, size_t len) const;
+    size_t adapterCut(const char *seq, size_t len) const;
+};
+
+#endif
@@ -154,19 +154,49 @@ std::vector<struct Command> commands = {
                 "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
                 "<i:sequenceDB> <i:alignmentDB> <o:sequenceDB>",
                 CITATION_MMSEQS2},
-        {"filternoncoding",      filternoncoding,      &par.onlythreads,          COMMAND_HIDDEN,
+        {"filternoncoding",      filternoncoding,      &par.filternoncoding,      COMMAND_HIDDEN,
                 "Filter non-coding protein sequences",
                 NULL,
                 "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
                 "<i:sequenceDB> <o:sequenceDB>",
                 CITATION_MMSEQS2},
+        {"checkcodingmodel",     checkcodingmodel,     &par.checkcodingmodel,     COMMAND_HIDDEN,
+                "Compare predictions of the float and int8 quantized coding model",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:codingSequenceDB> <i:noncodingSequenceDB>",
+                CITATION_MMSEQS2},
 
-        {"mergereads",      mergereads,      &par.onlythreads,          COMMAND_HIDDEN,
-                "Merge paired-end reads from FASTQ file (powered by FLASH)",
+        {"mergereads",      mergereads,      &par.mergereads,           COMMAND_HIDDEN,
+                "Merge paired-end reads from FASTQ file (powered by FLASH), optionally trim low quality tails and adapters",
                 NULL,
                 "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
                 "<i:fastq> <o:sequenceDB>",
                 CITATION_MMSEQS2},
+        {"dereplicate",      dereplicate,      &par.dereplicate,          COMMAND_HIDDEN,
+                "Collapse identical reads and their reverse complements into one read",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_MMSEQS2},
+        {"diginorm",      diginorm,      &par.diginorm,          COMMAND_HIDDEN,
+                "Digital normalization: drop reads whose k-mers already reached the target coverage",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_MMSEQS2},
+        {"filtersolidkmers",      filtersolidkmers,      &par.filtersolidkmers,          COMMAND_HIDDEN,
+                "Drop sequences without a k-mer that occurs at least twice in the database",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_MMSEQS2},
+        {"sixframeorfs",      sixframeorfs,      &par.sixframeorfs,          COMMAND_HIDDEN,
+                "Extract the start fragments and long ORFs of all six frames and translate them in one pass",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_MMSEQS2},
         {"shellcompletion",      shellcompletion,      &par.empty,                COMMAND_HIDDEN,
                 "",
                 NULL,
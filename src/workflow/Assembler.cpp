@@ -1,10 +1,13 @@
 #include <mmseqs/src/commons/DBReader.h>
 #include "Util.h"
-#include "CommandCaller.h"
 #include "Debug.h"
 #include "FileUtil.h"
 #include "LocalParameters.h"
-#include "assembler.sh.h"
+#include "WorkflowRunner.h"
+
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
 
 void setAssemblerWorkflowDefaults(LocalParameters *p) {
     p->spacedKmer = false;
@@ -23,6 +26,8 @@ void setAssemblerWorkflowDefaults(LocalParameters *p) {
 
 int assembler(int argc, const char **argv, const Command& command) {
     LocalParameters& par = LocalParameters::getLocalInstance();
+    // the steps have to see the parameters as they were before the workflow defaults
+    WorkflowRunner runner;
     setAssemblerWorkflowDefaults(&par);
     par.overrideParameterDescription((Command &)command, par.PARAM_COV_MODE.uniqid, NULL, NULL, par.PARAM_COV_MODE.category | MMseqsParameter::COMMAND_EXPERT);
     par.overrideParameterDescription((Command &)command, par.PARAM_C.uniqid, NULL, NULL, par.PARAM_C.category | MMseqsParameter::COMMAND_EXPERT);
@@ -37,32 +42,34 @@ int assembler(int argc, const char **argv, const Command& command) {
     par.overrideParameterDescription((Command &)command, par.PARAM_SORT_RESULTS.uniqid, NULL, NULL,  par.PARAM_SORT_RESULTS.category | MMseqsParameter::COMMAND_EXPERT);
 
 
+    // - reads from stdin or writes to stdout, everything the workflow prints then goes
+    // to stderr and only the assembled sequences are written to the original stdout
+    int stdoutFd = -1;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            stdoutFd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+            break;
+        }
+    }
+
 //    par.parseParameters(argc, argv, command, 3);
     par.parseParameters(argc, argv, command, 2, true, Parameters::PARSE_VARIADIC);
-    CommandCaller cmd;
 
     // paired end reads
-    if((par.filenames.size() - 2) % 2  == 0 ){
-        std::string readStr = "";
-        for(size_t i = 0; i < (par.filenames.size() -2)/2; i++){
-            readStr.append(par.filenames[i*2]);
-            readStr.append(" ");
-            readStr.append(par.filenames[i*2 + 1]);
-        }
-        cmd.addVariable("PAIRED_END", "1");
-        cmd.addVariable("READ_FILES", readStr.c_str());
-    }else{
-        if(par.filenames.size() == 3){
-            cmd.addVariable("READ_FILES", par.filenames[0].c_str());
-        }else{
-            Debug(Debug::ERROR) << "Read input parameters are wrong. \n";
-            Debug(Debug::ERROR) << "For paired end input use READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta  \n";
-            Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta  \n";
-            EXIT(EXIT_FAILURE);
-        }
+    const bool pairedEnd = (par.filenames.size() - 2) % 2 == 0;
+    if (pairedEnd == false && par.filenames.size() != 3) {
+        Debug(Debug::ERROR) << "Read input parameters are wrong. \n";
+        Debug(Debug::ERROR) << "For paired end input use READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta  \n";
+        Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta  \n";
+        EXIT(EXIT_FAILURE);
+    }
+    const std::vector<std::string> readFiles(par.filenames.begin(), par.filenames.end() - 2);
+    const std::string outFile = par.filenames[par.filenames.size() - 2];
+    if (outFile != "-" && FileUtil::fileExists(outFile.c_str())) {
+        Debug(Debug::ERROR) << outFile << " exists already!\n";
+        EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("OUT_FILE", par.filenames[par.filenames.size() - 2].c_str());
-    cmd.addVariable("PROTEIN_FILTER", "1");
 
     std::string tmpPath = par.filenames[par.filenames.size() - 1];
     if (FileUtil::directoryExists(tmpPath.c_str()) == false){
@@ -75,6 +82,10 @@ int assembler(int argc, const char **argv, const Command& command) {
         }
     }
     size_t hash = par.hashParameter(par.filenames, par.searchworkflow);
+    // a stream can not be resumed, every run from stdin gets its own temporary directory
+    if (par.filenames.size() == 3 && par.filenames[0] == "-") {
+        hash ^= (static_cast<size_t>(time(NULL)) << 20) ^ static_cast<size_t>(getpid());
+    }
     std::string tmpDir(tmpPath + "/" + SSTR(hash));
     if (FileUtil::directoryExists(tmpDir.c_str()) == false) {
         if (FileUtil::makeDir(tmpDir.c_str()) == false) {
@@ -82,32 +93,122 @@ int assembler(int argc, const char **argv, const Command& command) {
             EXIT(EXIT_FAILURE);
         }
     }
-    par.filenames.pop_back();
-    par.filenames.push_back(tmpDir);
     FileUtil::symlinkAlias(tmpDir, "latest");
-    cmd.addVariable("TMP_PATH", tmpDir.c_str());
 
-    if (par.removeTmpFiles) {
-        cmd.addVariable("REMOVE_TMP", "TRUE");
+    if (par.runner.empty() == false) {
+        Debug(Debug::ERROR) << "The steps run within this process, --mpi-runner is not supported.\n";
+        EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("RUNNER", par.runner.c_str());
-    cmd.addVariable("NUM_IT", SSTR(par.numIterations).c_str());
+    const std::string mergereadsPar = par.createParameterString(par.mergereads);
+    const bool trimReads = par.trimQuality > 0 || par.adapters.empty() == false;
+    const std::string diginormPar = par.diginormCoverage > 0 ? par.createParameterString(par.diginorm) : "";
     // nucleotide assembly
 
 
 
     // # 1. Finding exact $k$-mer matches.
-    cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
+    const std::string kmermatcherPar = par.createParameterString(par.kmermatcher);
+    // fragments without a repeated k-mer cannot get a k-mer match and never take part in the assembly
+    const std::string solidKmerPar = par.solidKmerFilter == 1 ? par.createParameterString(par.filtersolidkmers) : "";
 
     // # 2. Hamming distance pre-clustering
     par.filterHits = false;
     par.rescoreMode = Parameters::RESCORE_MODE_ALIGNMENT;
-    cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
-    cmd.addVariable("ASSEMBLE_RESULT_PAR", par.createParameterString(par.assembleresults).c_str());
+    const std::string ungappedAlnPar = par.createParameterString(par.rescorediagonal);
+    const std::string assembleResultPar = par.createParameterString(par.assembleresults);
+    // every step parses its parameters into par again, so the workflow settings are kept here
+    const int iterations = par.numIterations;
+    const bool removeTmpFiles = par.removeTmpFiles;
+    const bool dereplicate = par.dereplicateReads == 1;
+    const std::string tmp = tmpDir + "/";
+
+    std::vector<std::string> files(readFiles);
+    files.push_back(tmp + "nucl_reads");
+    const std::string &readFile = readFiles[0];
+    const bool isGzip = readFile.size() > 3 && readFile.compare(readFile.size() - 3, 3, ".gz") == 0;
+    if (pairedEnd) {
+        Debug(Debug::INFO) << "Paired end mode\n";
+        runner.run("mergereads", files.back(), files, mergereadsPar);
+    } else if (trimReads || isGzip || readFile == "-") {
+        // single-end reads go through mergereads for trimming, the parallel BGZF reader and stdin
+        runner.run("mergereads", files.back(), files, mergereadsPar);
+    } else {
+        runner.run("createdb", files.back(), files);
+    }
+
+    std::string input = tmp + "nucl_reads";
+    // collapse identical reads, the unique reads keep their keys and headers
+    if (dereplicate) {
+        runner.run("dereplicate", tmp + "nucl_reads_derep", {input, tmp + "nucl_reads_derep"});
+        input = tmp + "nucl_reads_derep";
+    }
+    // digital normalization, drop reads whose k-mers already reached the target coverage
+    if (diginormPar.empty() == false) {
+        runner.run("diginorm", tmp + "nucl_reads_norm", {input, tmp + "nucl_reads_norm"}, diginormPar);
+        input = tmp + "nucl_reads_norm";
+    }
 
-    FileUtil::writeFile(tmpDir + "/assembler.sh", assembler_sh, assembler_sh_len);
-    std::string program(tmpDir + "/assembler.sh");
-    cmd.execProgram(program.c_str(), par.filenames);
+    // start fragments and long ORFs of all six frames, translated, in one pass over the reads
+    runner.run("sixframeorfs", tmp + "aa_6f_start_long", {input, tmp + "aa_6f_start_long"});
+
+    input = tmp + "aa_6f_start_long";
+    // fragments without a k-mer that occurs twice cannot get a k-mer match in the first iteration,
+    // they are set aside for it and join the assembly again afterwards
+    const std::string droppedFragments = tmp + "aa_6f_start_long_solid_dropped";
+    if (solidKmerPar.empty() == false) {
+        runner.run("filtersolidkmers", tmp + "aa_6f_start_long_solid", {input, tmp + "aa_6f_start_long_solid"}, solidKmerPar);
+        input = tmp + "aa_6f_start_long_solid";
+    }
+
+    for (int step = 0; step < iterations; step++) {
+        Debug(Debug::INFO) << "STEP: " << step << "\n";
+        const std::string pref = tmp + "pref_" + SSTR(step);
+        const std::string aln = tmp + "aln_" + SSTR(step);
+        const std::string assembly = tmp + "assembly_" + SSTR(step);
+
+        if (step == 1 && solidKmerPar.empty() == false) {
+            // later iterations match contigs and corrected sequences, the dropped fragments might match these
+            const std::string merged = tmp + "assembly_0_with_dropped";
+            runner.run("mergedatabases", WorkflowRunner::mergeDatabases, merged, {input, droppedFragments, merged});
+            input = merged;
+        }
+
+        // 1. Finding exact $k$-mer matches.
+        runner.run("kmermatcher", pref, {input, pref}, kmermatcherPar);
+        // 2. Ungapped alignment
+        runner.run("rescorediagonal", aln, {input, input, pref, aln}, ungappedAlnPar);
+        if (step == 0) {
+            runner.run("findassemblystart", tmp + "corrected_seqs", {input, aln, tmp + "corrected_seqs"});
+            input = tmp + "corrected_seqs";
+            const std::string alnCorrected = tmp + "aln_corrected_" + SSTR(step);
+            runner.run("rescorediagonal", alnCorrected, {input, input, pref, alnCorrected}, ungappedAlnPar);
+            runner.run("assembleresults", assembly, {input, alnCorrected, assembly}, assembleResultPar);
+        } else {
+            // 3. Assemble
+            runner.run("assembleresults", assembly, {input, aln, assembly}, assembleResultPar);
+        }
+        input = assembly;
+    }
+
+    // post processing, keeps only assembled sequences that are predicted to be coding
+    const std::string result = input + "_filtered";
+    runner.run("filternoncoding", result, {input, result}, "--extended-from " + tmp + "aa_6f_start_long");
+
+    WorkflowRunner::symlinkFile(tmp + "aa_6f_start_long_h", result + "_h");
+    WorkflowRunner::symlinkFile(tmp + "aa_6f_start_long_h.index", result + "_h.index");
+    if (outFile == "-") {
+        // stream the sequences to the stdout plass was called with, without a FASTA copy in the tmp folder
+        runner.run("convert2fasta", "", {result, "/dev/fd/" + SSTR(stdoutFd)});
+    } else {
+        runner.run("convert2fasta", result + ".fasta", {result, result + ".fasta"});
+        WorkflowRunner::moveFile(result + ".fasta", outFile);
+    }
+
+    if (removeTmpFiles) {
+        Debug(Debug::INFO) << "Removing temporary files\n";
+        WorkflowRunner::removeFiles(tmpDir, {"pref_", "aln_", "assembly_"});
+    }
+    runner.printSummary();
 
     return EXIT_SUCCESS;
 }
@@ -1,10 +1,9 @@
 #include <mmseqs/src/commons/DBReader.h>
 #include "Util.h"
-#include "CommandCaller.h"
 #include "Debug.h"
 #include "FileUtil.h"
 #include "LocalParameters.h"
-#include "hybridassembler.sh.h"
+#include "WorkflowRunner.h"
 
 void setHybridAssemblerWorkflowDefaults(LocalParameters *p) {
     p->spacedKmer = false;
@@ -22,8 +21,14 @@ void setHybridAssemblerWorkflowDefaults(LocalParameters *p) {
 
 int hybridassembler(int argc, const char **argv, const Command& command) {
     LocalParameters& par = LocalParameters::getLocalInstance();
+    // the steps have to see the parameters as they were before the workflow defaults
+    WorkflowRunner runner;
     setHybridAssemblerWorkflowDefaults(&par);
     par.parseParameters(argc, argv, command, 3);
+    if (FileUtil::fileExists(par.db2.c_str())) {
+        Debug(Debug::ERROR) << par.db2 << " exists already!\n";
+        EXIT(EXIT_FAILURE);
+    }
 
     const int dbType = DBReader<unsigned int>::parseDbType(par.db1.c_str());
 
@@ -44,16 +49,12 @@ int hybridassembler(int argc, const char **argv, const Command& command) {
             EXIT(EXIT_FAILURE);
         }
     }
-    par.filenames.pop_back();
-    par.filenames.push_back(tmpDir);
     FileUtil::symlinkAlias(tmpDir, "latest");
 
-    CommandCaller cmd;
-    if (par.removeTmpFiles) {
-        cmd.addVariable("REMOVE_TMP", "TRUE");
+    if (par.runner.empty() == false) {
+        Debug(Debug::ERROR) << "The steps run within this process, --mpi-runner is not supported.\n";
+        EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("RUNNER", par.runner.c_str());
-    cmd.addVariable("NUM_IT", SSTR(par.numIterations).c_str());
 
     // save some values to restore them later
     size_t alphabetSize = par.alphabetSize;
@@ -61,8 +62,8 @@ int hybridassembler(int argc, const char **argv, const Command& command) {
 
     // # 1. Finding exact $k$-mer matches.
 
-    cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
-    cmd.addVariable("NUCL_ASM_PAR", par.createParameterString(par.kmermatcher).c_str());
+    const std::string kmermatcherPar = par.createParameterString(par.kmermatcher);
+    const std::string nuclAsmPar = par.createParameterString(par.kmermatcher);
 
     par.alphabetSize = alphabetSize;
     par.kmerSize = kmerSize;
@@ -70,12 +71,68 @@ int hybridassembler(int argc, const char **argv, const Command& command) {
     // # 2. Hamming distance pre-clustering
     par.filterHits = false;
     par.rescoreMode = Parameters::RESCORE_MODE_ALIGNMENT;
-    cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
-    cmd.addVariable("ASSEMBLE_RESULT_PAR", par.createParameterString(par.assembleresults).c_str());
+    const std::string ungappedAlnPar = par.createParameterString(par.rescorediagonal);
+    const std::string assembleResultPar = par.createParameterString(par.assembleresults);
+    // every step parses its parameters into par again, so the workflow settings are kept here
+    const int iterations = par.numIterations;
+    const int threads = par.threads;
+    const bool removeTmpFiles = par.removeTmpFiles;
+    const std::string outDb = par.db2;
+    const std::string tmp = tmpDir + "/";
+    const std::string input = par.db1;
+
+    // the start and long fragments are independent until they are concatenated
+    const size_t nuclStart = runner.addStep("extractorfs", tmp + "nucl_6f_start", {input, tmp + "nucl_6f_start"},
+                                            "--contig-start-mode 1 --contig-end-mode 0 --orf-start-mode 0 --min-length 30 --max-length 45 --max-gaps 0");
+    const size_t aaStart = runner.addStep("translatenucs", tmp + "aa_6f_start", {tmp + "nucl_6f_start", tmp + "aa_6f_start"},
+                                          "--add-orf-stop", {nuclStart});
+    const size_t nuclLong = runner.addStep("extractorfs", tmp + "nucl_6f_long", {input, tmp + "nucl_6f_long"},
+                                           "--orf-start-mode 0 --min-length 45 --max-gaps 0");
+    const size_t aaLong = runner.addStep("translatenucs", tmp + "aa_6f_long", {tmp + "nucl_6f_long", tmp + "aa_6f_long"},
+                                         "--add-orf-stop", {nuclLong});
+    runner.addStep("concatdbs", tmp + "aa_6f_start_long", {tmp + "aa_6f_long", tmp + "aa_6f_start", tmp + "aa_6f_start_long"},
+                   "", {aaStart, aaLong});
+    runner.addStep("concatdbs", tmp + "nucl_6f_start_long", {tmp + "nucl_6f_long", tmp + "nucl_6f_start", tmp + "nucl_6f_start_long"},
+                   "", {nuclStart, nuclLong});
+    runner.runSteps(threads);
+
+    std::string inputAa = tmp + "aa_6f_start_long";
+    std::string inputNucl = tmp + "nucl_6f_start_long";
+    for (int step = 0; step < iterations; step++) {
+        Debug(Debug::INFO) << "STEP: " << step << "\n";
+        const std::string pref = tmp + "pref_" + SSTR(step);
+        const std::string aln = tmp + "aln_" + SSTR(step);
+        const std::string alnNucl = tmp + "aln_nucl_" + SSTR(step);
+        const std::string assemblyAa = tmp + "assembly_aa_" + SSTR(step);
+        const std::string assemblyNucl = tmp + "assembly_nucl_" + SSTR(step);
 
-    FileUtil::writeFile(par.db3 + "/hybridassembler.sh", hybridassembler_sh, hybridassembler_sh_len);
-    std::string program(par.db3 + "/hybridassembler.sh");
-    cmd.execProgram(program.c_str(), par.filenames);
+        // 1. Finding exact $k$-mer matches.
+        runner.run("kmermatcher", pref, {inputAa, pref}, kmermatcherPar);
+        // 2. Ungapped alignment
+        runner.run("rescorediagonal", aln, {inputAa, inputAa, pref, aln}, ungappedAlnPar);
+        // 3. Ungapped alignment protein 2 nucl
+        runner.run("proteinaln2nucl", alnNucl, {inputNucl, inputNucl, aln, alnNucl});
+        // 4. Assemble
+        runner.run("hybridassembleresults", assemblyAa, {inputNucl, inputAa, alnNucl, assemblyNucl, assemblyAa}, assembleResultPar);
+
+        inputAa = assemblyAa;
+        inputNucl = assemblyNucl;
+    }
+
+    runner.run("changedkeys", WorkflowRunner::writeChangedKeys, tmp + "assembled_ids",
+               {inputNucl, tmp + "nucl_6f_start_long", tmp + "assembled_ids"});
+    runner.run("createsubdb", "", {tmp + "assembled_ids", inputNucl, inputNucl + "_assembled"});
+    runner.run("concatdbs", "", {inputNucl + "_assembled", input, inputNucl + "_assembled_input_reads"});
+    runner.run("nuclassemble", "", {inputNucl + "_assembled_input_reads", inputNucl + "_2", tmp + "nuclassembly_2"}, nuclAsmPar);
+
+    WorkflowRunner::moveFile(inputNucl + "_2", outDb + "_nucl");
+    WorkflowRunner::moveFile(inputNucl + "_2.index", outDb + "_nucl.index");
+
+    if (removeTmpFiles) {
+        Debug(Debug::INFO) << "Removing temporary files\n";
+        WorkflowRunner::removeFiles(tmpDir, {"pref_", "aln_", "assembly_"});
+    }
+    runner.printSummary();
 
     return EXIT_SUCCESS;
 }
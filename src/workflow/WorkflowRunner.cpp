@@ -0,0 +1,631 @@
+#include "WorkflowRunner.h"
+#include "Command.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "Util.h"
+#include "Parameters.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <typeinfo>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+extern std::vector<Command> commands;
+
+WorkflowRunner::WorkflowRunner() {
+    std::set<void *> seen;
+    for (size_t i = 0; i < commands.size(); i++) {
+        std::vector<MMseqsParameter> *params = commands[i].params;
+        if (params == NULL) {
+            continue;
+        }
+        for (size_t j = 0; j < params->size(); j++) {
+            MMseqsParameter &parameter = (*params)[j];
+            savedWasSet.push_back(std::make_pair(&parameter, parameter.wasSet));
+            // copies of a parameter point to the same value
+            if (parameter.value == NULL || seen.insert(parameter.value).second == false) {
+                continue;
+            }
+            SavedValue value;
+            value.parameter = &parameter;
+            value.intValue = 0;
+            value.floatValue = 0.0f;
+            value.doubleValue = 0.0;
+            value.boolValue = false;
+            value.sizeValue = 0;
+            if (parameter.type == typeid(int)) {
+                value.intValue = *static_cast<int *>(parameter.value);
+            } else if (parameter.type == typeid(float)) {
+                value.floatValue = *static_cast<float *>(parameter.value);
+            } else if (parameter.type == typeid(double)) {
+                value.doubleValue = *static_cast<double *>(parameter.value);
+            } else if (parameter.type == typeid(bool)) {
+                value.boolValue = *static_cast<bool *>(parameter.value);
+            } else if (parameter.type == typeid(size_t)) {
+                value.sizeValue = *static_cast<size_t *>(parameter.value);
+            } else if (parameter.type == typeid(std::string)) {
+                value.stringValue = *static_cast<std::string *>(parameter.value);
+            } else {
+                // no command parses other types from the command line
+                continue;
+            }
+            saved.push_back(value);
+        }
+    }
+}
+
+void WorkflowRunner::restoreParameters() {
+    for (size_t i = 0; i < saved.size(); i++) {
+        const SavedValue &value = saved[i];
+        const MMseqsParameter &parameter = *value.parameter;
+        if (parameter.type == typeid(int)) {
+            *static_cast<int *>(parameter.value) = value.intValue;
+        } else if (parameter.type == typeid(float)) {
+            *static_cast<float *>(parameter.value) = value.floatValue;
+        } else if (parameter.type == typeid(double)) {
+            *static_cast<double *>(parameter.value) = value.doubleValue;
+        } else if (parameter.type == typeid(bool)) {
+            *static_cast<bool *>(parameter.value) = value.boolValue;
+        } else if (parameter.type == typeid(size_t)) {
+            *static_cast<size_t *>(parameter.value) = value.sizeValue;
+        } else if (parameter.type == typeid(std::string)) {
+            *static_cast<std::string *>(parameter.value) = value.stringValue;
+        }
+    }
+    for (size_t i = 0; i < savedWasSet.size(); i++) {
+        savedWasSet[i].first->wasSet = savedWasSet[i].second;
+    }
+}
+
+const Command &WorkflowRunner::findCommand(const std::string &command) const {
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (command == commands[i].cmd) {
+            return commands[i];
+        }
+    }
+    Debug(Debug::ERROR) << "Workflow step " << command << " is not a known command.\n";
+    EXIT(EXIT_FAILURE);
+}
+
+void WorkflowRunner::recordTiming(const std::string &command, const std::string &output, double seconds, bool skipped) {
+    StepTiming timing;
+    timing.step = command + (output.empty() ? "" : " " + output);
+    timing.seconds = seconds;
+    timing.skipped = skipped;
+    timings.push_back(timing);
+}
+
+static double secondsSince(const struct timeval &start) {
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+// split like the unquoted parameter variables in the shell scripts were
+static std::vector<std::string> buildArguments(const std::vector<std::string> &files, const std::string &parameters) {
+    std::vector<std::string> args(files);
+    std::istringstream parameterStream(parameters);
+    std::string parameter;
+    while (parameterStream >> parameter) {
+        args.push_back(parameter);
+    }
+    return args;
+}
+
+static int callCommand(const Command &step, const std::vector<std::string> &args) {
+    std::vector<const char *> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(args[i].c_str());
+    }
+    argv.push_back(NULL);
+    return step.commandFunction(static_cast<int>(args.size()), argv.data(), step);
+}
+
+// path of this binary, concurrent steps run in their own instance of it
+static std::string executablePath() {
+    char path[PATH_MAX];
+#ifdef __APPLE__
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) == 0) {
+        return path;
+    }
+#else
+    const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length > 0) {
+        path[length] = '\0';
+        return path;
+    }
+#endif
+    Debug(Debug::ERROR) << "Could not find the path of the executable to start the workflow steps.\n";
+    EXIT(EXIT_FAILURE);
+}
+
+static std::string manifestFile(const std::string &output) {
+    return output + ".manifest";
+}
+
+// A step that runs again loses its manifest first, if it does not finish its partial
+// output is not taken for complete by the next run
+static void removeManifest(const std::string &output) {
+    if (output.empty()) {
+        return;
+    }
+    const std::string file = manifestFile(output);
+    if (unlink(file.c_str()) != 0 && errno != ENOENT) {
+        Debug(Debug::ERROR) << "Could not remove " << file << ": " << strerror(errno) << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+// FNV-1a of the file content
+static bool hashFile(const std::string &file, uint64_t &hash) {
+    FILE *handle = fopen(file.c_str(), "rb");
+    if (handle == NULL) {
+        return false;
+    }
+    hash = 14695981039346656037ULL;
+    std::vector<unsigned char> buffer(1024 * 1024);
+    size_t read;
+    while ((read = fread(buffer.data(), 1, buffer.size(), handle)) > 0) {
+        for (size_t i = 0; i < read; i++) {
+            hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+    }
+    fclose(handle);
+    return true;
+}
+
+// Databases are identified by their index, other files by size and modification time.
+// False if there is no such file, which makes the argument an output of the step.
+static bool fingerprint(const std::string &file, std::string &result) {
+    char buffer[64];
+    uint64_t hash;
+    if (hashFile(file + ".index", hash)) {
+        snprintf(buffer, sizeof(buffer), "index:%016llx", static_cast<unsigned long long>(hash));
+        result = buffer;
+        return true;
+    }
+    struct stat info;
+    if (stat(file.c_str(), &info) != 0 || S_ISREG(info.st_mode) == false) {
+        return false;
+    }
+    snprintf(buffer, sizeof(buffer), "file:%lld:%lld", static_cast<long long>(info.st_size), static_cast<long long>(info.st_mtime));
+    result = buffer;
+    return true;
+}
+
+std::string WorkflowRunner::createManifest(const std::string &command, const std::string &output,
+                                           const std::vector<std::string> &files, const std::string &parameters) const {
+    std::string manifest = "command\t" + command + "\narguments";
+    for (size_t i = 0; i < files.size(); i++) {
+        manifest += "\t" + files[i];
+    }
+    // the thread count and verbosity do not change the result
+    manifest += "\nparameters";
+    std::istringstream parameterStream(parameters);
+    std::string parameter;
+    while (parameterStream >> parameter) {
+        if (parameter == "--threads" || parameter == "-v") {
+            parameterStream >> parameter;
+            continue;
+        }
+        manifest += "\t" + parameter;
+    }
+    manifest += "\n";
+    std::string inputFingerprint;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (files[i] != output && fingerprint(files[i], inputFingerprint)) {
+            manifest += "input\t" + files[i] + "\t" + inputFingerprint + "\n";
+        }
+    }
+    return manifest;
+}
+
+bool WorkflowRunner::isDone(const std::string &command, const std::string &output,
+                            const std::vector<std::string> &files, const std::string &parameters) const {
+    if (output.empty() || FileUtil::fileExists(output.c_str()) == false) {
+        return false;
+    }
+    std::ifstream manifest(manifestFile(output).c_str());
+    std::string recorded((std::istreambuf_iterator<char>(manifest)), std::istreambuf_iterator<char>());
+    // the inputs as they were recorded, further arguments that exist now are outputs of the step
+    const std::string expected = createManifest(command, output, files, parameters);
+    const size_t headerEnd = expected.find("\ninput\t") == std::string::npos ? expected.size() : expected.find("\ninput\t") + 1;
+    bool matches = manifest.fail() == false && recorded.compare(0, headerEnd, expected, 0, headerEnd) == 0;
+    std::istringstream inputs(recorded.substr(std::min(headerEnd, recorded.size())));
+    std::string line;
+    while (matches && std::getline(inputs, line)) {
+        const size_t pathStart = line.find('\t');
+        const size_t pathEnd = line.rfind('\t');
+        std::string current;
+        matches = line.compare(0, pathStart, "input") == 0 && pathEnd > pathStart
+                  && fingerprint(line.substr(pathStart + 1, pathEnd - pathStart - 1), current)
+                  && current == line.substr(pathEnd + 1);
+    }
+    if (matches == false) {
+        Debug(Debug::INFO) << output << " exists but does not match its manifest, computing it again\n";
+        removeManifest(output);
+    }
+    return matches;
+}
+
+void WorkflowRunner::writeManifest(const std::string &output, const std::string &manifest) {
+    if (output.empty()) {
+        return;
+    }
+    // written next to the manifest and renamed, a manifest is either complete or missing
+    const std::string file = manifestFile(output);
+    const std::string tmpFile = file + ".tmp";
+    FILE *handle = FileUtil::openFileOrDie(tmpFile.c_str(), "w", false);
+    if (fwrite(manifest.c_str(), 1, manifest.size(), handle) != manifest.size()
+        || fflush(handle) != 0 || fsync(fileno(handle)) != 0 || fclose(handle) != 0
+        || rename(tmpFile.c_str(), file.c_str()) != 0) {
+        Debug(Debug::ERROR) << "Could not write " << file << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+void WorkflowRunner::run(const std::string &command, const std::string &output,
+                         const std::vector<std::string> &files, const std::string &parameters) {
+    if (isDone(command, output, files, parameters)) {
+        recordTiming(command, output, 0.0, true);
+        return;
+    }
+    execute(command, output, files, parameters);
+}
+
+void WorkflowRunner::execute(const std::string &command, const std::string &output,
+                             const std::vector<std::string> &files, const std::string &parameters) {
+    // inputs are fingerprinted before the step can create further outputs
+    const std::string manifest = createManifest(command, output, files, parameters);
+    removeManifest(output);
+    const Command &step = findCommand(command);
+    const std::vector<std::string> args = buildArguments(files, parameters);
+    restoreParameters();
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    const int status = callCommand(step, args);
+    if (status != EXIT_SUCCESS) {
+        Debug(Debug::ERROR) << "Workflow step " << command << " died.\n";
+        EXIT(EXIT_FAILURE);
+    }
+    writeManifest(output, manifest);
+    recordTiming(command, output, secondsSince(start), false);
+}
+
+void WorkflowRunner::run(const std::string &name, StepFunction function, const std::string &output,
+                         const std::vector<std::string> &files) {
+    if (isDone(name, output, files, "")) {
+        recordTiming(name, output, 0.0, true);
+        return;
+    }
+    const std::string manifest = createManifest(name, output, files, "");
+    removeManifest(output);
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    function(files);
+    writeManifest(output, manifest);
+    recordTiming(name, output, secondsSince(start), false);
+}
+
+size_t WorkflowRunner::addStep(const std::string &command, const std::string &output,
+                               const std::vector<std::string> &files, const std::string &parameters,
+                               const std::vector<size_t> &dependencies) {
+    PendingStep step;
+    step.command = command;
+    step.output = output;
+    step.files = files;
+    step.parameters = parameters;
+    step.dependencies = dependencies;
+    pending.push_back(step);
+    return pending.size() - 1;
+}
+
+void WorkflowRunner::runSteps(int threads) {
+    enum { WAITING, RUNNING, DONE };
+    std::vector<int> state(pending.size(), WAITING);
+    std::vector<struct timeval> started(pending.size());
+    std::map<pid_t, size_t> running;
+    size_t done = 0;
+    const int threadsId = Parameters::getInstance().PARAM_THREADS.uniqid;
+    std::string executable;
+
+    while (done < pending.size()) {
+        const size_t doneBefore = done;
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < pending.size(); i++) {
+            bool isReady = state[i] == WAITING;
+            for (size_t j = 0; isReady && j < pending[i].dependencies.size(); j++) {
+                isReady = state[pending[i].dependencies[j]] == DONE;
+            }
+            if (isReady == false) {
+                continue;
+            }
+            // same as run, the step is skipped if its output matches its manifest
+            if (isDone(pending[i].command, pending[i].output, pending[i].files, pending[i].parameters)) {
+                recordTiming(pending[i].command, pending[i].output, 0.0, true);
+                state[i] = DONE;
+                done++;
+                continue;
+            }
+            ready.push_back(i);
+        }
+        if (ready.empty() && running.empty()) {
+            if (done > doneBefore) {
+                // steps after skipped steps might be ready now
+                continue;
+            }
+            if (done < pending.size()) {
+                Debug(Debug::ERROR) << "Workflow steps depend on each other in a cycle.\n";
+                EXIT(EXIT_FAILURE);
+            }
+            break;
+        }
+
+        if (ready.size() == 1 && running.empty()) {
+            const PendingStep &step = pending[ready[0]];
+            // its manifest was checked above already
+            execute(step.command, step.output, step.files, step.parameters);
+            state[ready[0]] = DONE;
+            done++;
+            continue;
+        }
+
+        const int share = std::max(1, threads / static_cast<int>(running.size() + ready.size()));
+        for (size_t i = 0; i < ready.size(); i++) {
+            PendingStep &step = pending[ready[i]];
+            step.manifest = createManifest(step.command, step.output, step.files, step.parameters);
+            removeManifest(step.output);
+            const Command &command = findCommand(step.command);
+            std::string parameters = step.parameters;
+            for (size_t j = 0; command.params != NULL && j < command.params->size(); j++) {
+                if ((*command.params)[j].uniqid == threadsId) {
+                    // the last value on the command line wins
+                    parameters += " --threads " + SSTR(share);
+                    break;
+                }
+            }
+            if (executable.empty()) {
+                executable = executablePath();
+            }
+            std::vector<std::string> args = buildArguments(step.files, parameters);
+            args.insert(args.begin(), step.command);
+            args.insert(args.begin(), executable);
+            std::vector<char *> argv;
+            for (size_t j = 0; j < args.size(); j++) {
+                argv.push_back(const_cast<char *>(args[j].c_str()));
+            }
+            argv.push_back(NULL);
+
+            // the child would print everything that is still buffered again
+            std::cout.flush();
+            fflush(NULL);
+            gettimeofday(&started[ready[i]], NULL);
+            // Steps that ran in this process started the OpenMP thread pool, a forked copy of
+            // it hangs in its first parallel region. The child only calls exec and starts the
+            // step in a fresh instance of this binary, which also parses it from the defaults.
+            const pid_t pid = fork();
+            if (pid < 0) {
+                Debug(Debug::ERROR) << "Could not start workflow step " << step.command << ".\n";
+                EXIT(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                execv(argv[0], argv.data());
+                _exit(EXIT_FAILURE);
+            }
+            running[pid] = ready[i];
+            state[ready[i]] = RUNNING;
+        }
+
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        std::map<pid_t, size_t>::iterator it = running.find(pid);
+        if (pid < 0 || it == running.end()) {
+            Debug(Debug::ERROR) << "Could not wait for the workflow steps.\n";
+            EXIT(EXIT_FAILURE);
+        }
+        const size_t id = it->second;
+        running.erase(it);
+        if (WIFEXITED(status) == false || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            Debug(Debug::ERROR) << "Workflow step " << pending[id].command << " died.\n";
+            for (it = running.begin(); it != running.end(); ++it) {
+                kill(it->first, SIGTERM);
+            }
+            EXIT(EXIT_FAILURE);
+        }
+        writeManifest(pending[id].output, pending[id].manifest);
+        recordTiming(pending[id].command, pending[id].output, secondsSince(started[id]), false);
+        state[id] = DONE;
+        done++;
+    }
+    pending.clear();
+}
+
+void WorkflowRunner::printSummary() const {
+    Debug(Debug::INFO) << "Workflow steps:\n";
+    for (size_t i = 0; i < timings.size(); i++) {
+        if (timings[i].skipped) {
+            Debug(Debug::INFO) << "  " << timings[i].step << ": skipped, matches its manifest\n";
+        } else {
+            Debug(Debug::INFO) << "  " << timings[i].step << ": " << timings[i].seconds << " s\n";
+        }
+    }
+}
+
+void WorkflowRunner::moveFile(const std::string &src, const std::string &dst) {
+    if (rename(src.c_str(), dst.c_str()) == 0) {
+        return;
+    }
+    if (errno != EXDEV) {
+        Debug(Debug::ERROR) << "Could not move " << src << " to " << dst << ": " << strerror(errno) << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+    // rename does not work across file systems
+    FILE *in = FileUtil::openFileOrDie(src.c_str(), "rb", true);
+    FILE *out = FileUtil::openFileOrDie(dst.c_str(), "wb", false);
+    std::vector<char> buffer(1024 * 1024);
+    size_t read;
+    while ((read = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+        if (fwrite(buffer.data(), 1, read, out) != read) {
+            Debug(Debug::ERROR) << "Could not write " << dst << ".\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    fclose(in);
+    if (fclose(out) != 0) {
+        Debug(Debug::ERROR) << "Could not write " << dst << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+    FileUtil::deleteFile(src);
+}
+
+void WorkflowRunner::symlinkFile(const std::string &target, const std::string &link) {
+    if (FileUtil::fileExists(link.c_str())) {
+        return;
+    }
+    char absolutePath[PATH_MAX];
+    if (realpath(target.c_str(), absolutePath) == NULL || symlink(absolutePath, link.c_str()) != 0) {
+        Debug(Debug::ERROR) << "Could not link " << target << " to " << link << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+void WorkflowRunner::removeFiles(const std::string &dir, const std::vector<std::string> &prefixes) {
+    DIR *handle = opendir(dir.c_str());
+    if (handle == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+        const std::string name(entry->d_name);
+        for (size_t i = 0; i < prefixes.size(); i++) {
+            if (name.compare(0, prefixes[i].size(), prefixes[i]) == 0) {
+                unlink((dir + "/" + name).c_str());
+                break;
+            }
+        }
+    }
+    closedir(handle);
+}
+
+struct IndexEntry {
+    std::string offset;
+    size_t length;
+};
+
+// key to offset and length, in the order of the index file
+static void readIndex(const std::string &indexFile, std::vector<unsigned int> &keys, std::map<unsigned int, IndexEntry> &entries) {
+    std::ifstream index(indexFile.c_str());
+    if (index.fail()) {
+        Debug(Debug::ERROR) << "Could not open " << indexFile << " for reading.\n";
+        EXIT(EXIT_FAILURE);
+    }
+    unsigned int key;
+    IndexEntry entry;
+    while (index >> key >> entry.offset >> entry.length) {
+        keys.push_back(key);
+        entries[key] = entry;
+    }
+}
+
+void WorkflowRunner::keepExtendedEntries(const std::vector<std::string> &files) {
+    const std::string &resultDb = files[0];
+    const std::string &startDb = files[1];
+    const std::string &outDb = files[2];
+    std::vector<unsigned int> resultKeys;
+    std::map<unsigned int, IndexEntry> result;
+    readIndex(resultDb + ".index", resultKeys, result);
+    std::vector<unsigned int> startKeys;
+    std::map<unsigned int, IndexEntry> start;
+    readIndex(startDb + ".index", startKeys, start);
+
+    const std::string extendedIndex = outDb + ".index";
+    FILE *out = FileUtil::openFileOrDie(extendedIndex.c_str(), "w", false);
+    for (size_t i = 0; i < startKeys.size(); i++) {
+        std::map<unsigned int, IndexEntry>::const_iterator it = result.find(startKeys[i]);
+        if (it != result.end() && it->second.length > start[startKeys[i]].length) {
+            fprintf(out, "%u\t%s\t%zu\n", it->first, it->second.offset.c_str(), it->second.length);
+        }
+    }
+    fclose(out);
+
+    // the index of resultDb is left alone, later steps and a resumed run still see all entries
+    symlinkFile(resultDb, outDb);
+}
+
+void WorkflowRunner::mergeDatabases(const std::vector<std::string> &files) {
+    const std::string &outDb = files.back();
+    FILE *data = FileUtil::openFileOrDie(outDb.c_str(), "wb", false);
+    FILE *index = FileUtil::openFileOrDie((outDb + ".index").c_str(), "w", false);
+    std::vector<char> buffer(1024 * 1024);
+    size_t dataOffset = 0;
+    for (size_t i = 0; i + 1 < files.size(); i++) {
+        std::vector<unsigned int> keys;
+        std::map<unsigned int, IndexEntry> entries;
+        readIndex(files[i] + ".index", keys, entries);
+        for (size_t j = 0; j < keys.size(); j++) {
+            const IndexEntry &entry = entries[keys[j]];
+            const size_t offset = dataOffset + strtoull(entry.offset.c_str(), NULL, 10);
+            fprintf(index, "%u\t%zu\t%zu\n", keys[j], offset, entry.length);
+        }
+        // the entries of this database are shifted by the data before it
+        FILE *in = FileUtil::openFileOrDie(files[i].c_str(), "rb", true);
+        size_t read;
+        while ((read = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+            if (fwrite(buffer.data(), 1, read, data) != read) {
+                Debug(Debug::ERROR) << "Could not write to " << outDb << ".\n";
+                EXIT(EXIT_FAILURE);
+            }
+            dataOffset += read;
+        }
+        fclose(in);
+    }
+    if (fclose(index) != 0 || fclose(data) != 0) {
+        Debug(Debug::ERROR) << "Could not write " << outDb << ".\n";
+        EXIT(EXIT_FAILURE);
+    }
+    const std::string dbType = files[0] + ".dbtype";
+    if (FileUtil::fileExists(dbType.c_str())) {
+        symlinkFile(dbType, outDb + ".dbtype");
+    }
+}
+
+void WorkflowRunner::writeChangedKeys(const std::vector<std::string> &files) {
+    const std::string &resultDb = files[0];
+    const std::string &startDb = files[1];
+    const std::string &keyFile = files[2];
+    std::vector<unsigned int> resultKeys;
+    std::map<unsigned int, IndexEntry> result;
+    readIndex(resultDb + ".index", resultKeys, result);
+    std::vector<unsigned int> startKeys;
+    std::map<unsigned int, IndexEntry> start;
+    readIndex(startDb + ".index", startKeys, start);
+
+    FILE *out = FileUtil::openFileOrDie(keyFile.c_str(), "w", false);
+    for (size_t i = 0; i < resultKeys.size(); i++) {
+        std::map<unsigned int, IndexEntry>::const_iterator it = start.find(resultKeys[i]);
+        if (it == start.end() || it->second.length != result[resultKeys[i]].length) {
+            fprintf(out, "%u\n", resultKeys[i]);
+        }
+    }
+    fclose(out);
+}
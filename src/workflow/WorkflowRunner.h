@@ -0,0 +1,123 @@
+#ifndef WORKFLOWRUNNER_H
+#define WORKFLOWRUNNER_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+class MMseqsParameter;
+struct Command;
+
+// Runs the steps of a workflow as direct calls of the command functions of this binary
+// instead of one process per step. Before every step the parameters are reset to the values
+// they had when the runner was created, which has to happen before the workflow parses its
+// own parameters. A step then parses exactly what a freshly started process would see.
+class WorkflowRunner {
+public:
+    WorkflowRunner();
+
+    // Calls the command with the files and the parameter string (split at whitespace like the
+    // shell did). A step with an output writes output.manifest when it finished. The manifest holds
+    // the command, its arguments and parameters and a fingerprint of every input (the index of
+    // databases, size and modification time of other files). The step is skipped only if output
+    // exists and its manifest matches, so partial outputs of a crashed step and outputs of other
+    // parameters or changed inputs are computed again.
+    void run(const std::string &command, const std::string &output,
+             const std::vector<std::string> &files, const std::string &parameters = "");
+
+    // Workflow functions that run like a step, they get the files of the step
+    typedef void (*StepFunction)(const std::vector<std::string> &files);
+
+    // Calls function with the files, skipped and recorded in a manifest like a command step
+    void run(const std::string &name, StepFunction function, const std::string &output,
+             const std::vector<std::string> &files);
+
+    // Adds a step for runSteps that starts once the steps with the given ids finished and returns its id
+    size_t addStep(const std::string &command, const std::string &output,
+                   const std::vector<std::string> &files, const std::string &parameters = "",
+                   const std::vector<size_t> &dependencies = std::vector<size_t>());
+
+    // Runs the added steps. Steps that are ready at the same time run concurrently as new
+    // processes of this binary and split the threads. A step that is ready alone runs in this
+    // process with its usual threads.
+    void runSteps(int threads);
+
+    // Seconds per step and skipped steps, in the order they ran
+    void printSummary() const;
+
+    // Moves src to dst, also across file systems
+    static void moveFile(const std::string &src, const std::string &dst);
+
+    // Symlinks link to the absolute path of target unless link exists
+    static void symlinkFile(const std::string &target, const std::string &link);
+
+    // Removes all files in dir whose name starts with one of the prefixes
+    static void removeFiles(const std::string &dir, const std::vector<std::string> &prefixes);
+
+    // files are resultDb, startDb and outDb. outDb gets the entries of resultDb that got longer
+    // than in startDb, its index points into the data of resultDb, which is linked
+    static void keepExtendedEntries(const std::vector<std::string> &files);
+
+    // files are the databases to merge and the output database last. The databases
+    // must not share keys, all keys are kept
+    static void mergeDatabases(const std::vector<std::string> &files);
+
+    // files are resultDb, startDb and keyFile. Writes the keys of resultDb whose length
+    // differs from startDb, one per line
+    static void writeChangedKeys(const std::vector<std::string> &files);
+
+private:
+    struct SavedValue {
+        const MMseqsParameter *parameter;
+        int intValue;
+        float floatValue;
+        double doubleValue;
+        bool boolValue;
+        size_t sizeValue;
+        std::string stringValue;
+    };
+
+    struct StepTiming {
+        std::string step;
+        double seconds;
+        bool skipped;
+    };
+
+    struct PendingStep {
+        std::string command;
+        std::string output;
+        std::vector<std::string> files;
+        std::string parameters;
+        std::vector<size_t> dependencies;
+        std::string manifest;
+    };
+
+    std::vector<SavedValue> saved;
+    // every command has its own copies of the parameters, each with its own wasSet
+    std::vector<std::pair<MMseqsParameter *, bool> > savedWasSet;
+    std::vector<StepTiming> timings;
+    std::vector<PendingStep> pending;
+
+    void restoreParameters();
+
+    const Command &findCommand(const std::string &command) const;
+
+    // Runs the step in this process and writes its manifest
+    void execute(const std::string &command, const std::string &output,
+                 const std::vector<std::string> &files, const std::string &parameters);
+
+    // Manifest of the step for its current inputs
+    std::string createManifest(const std::string &command, const std::string &output,
+                               const std::vector<std::string> &files, const std::string &parameters) const;
+
+    // true if output exists and its manifest matches
+    bool isDone(const std::string &command, const std::string &output,
+                const std::vector<std::string> &files, const std::string &parameters) const;
+
+    static void writeManifest(const std::string &output, const std::string &manifest);
+
+    void recordTiming(const std::string &command, const std::string &output, double seconds, bool skipped);
+};
+
+#endif